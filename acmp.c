@@ -0,0 +1,482 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Asynchronous file compare.  build_diff_db() does not compare the regular
+ * files of the list itself.  The entries get the pending marker '?' in
+ * filediff.diff and are compared by a background thread pool.  The rows in
+ * the viewport are compared first.  The main thread takes the results from
+ * acmp_poll() while it waits for a key, updates the list and applies the
+ * filters ("noequal", "real_diff") again.
+ *
+ * The worker threads do not access struct filediff.  A job is dropped when
+ * its filediff is freed (free_diff()). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <regex.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "diff.h"
+#include "exec.h"
+#include "uzp.h"
+#include "db.h"
+#include "ui2.h"
+#include "tc.h"
+#include "pool.h"
+#include "fcmp.h"
+#include "acmp.h"
+
+/* Job states */
+#define ACMP_QUEUE 0
+#define ACMP_RUN   1
+#define ACMP_DONE  2
+/* Result is applied or job is dropped */
+#define ACMP_FREE  3
+
+/* Poll interval in ms while compares are pending */
+#define ACMP_TMO 100
+
+struct acmp_job {
+	struct filediff *f;
+	char *pth[2];
+	char *err;
+	volatile int stop;
+	signed char res;
+	char st;
+};
+
+/* The jobs of one list */
+struct acmp_bat {
+	struct acmp_job *v; /* list order */
+	size_t *ix; /* indices into {v} sorted by {f} */
+	size_t num, siz;
+	size_t nxt; /* next job in list order */
+	size_t open; /* number of jobs which are not ACMP_FREE */
+	struct filediff **list; /* db_list of the jobs */
+	/* Results had been applied while the list was not displayed */
+	short refilt;
+	struct acmp_bat *next;
+};
+
+static struct acmp_job *acmp_next(struct acmp_bat **);
+static struct acmp_job *acmp_find(struct filediff *, struct acmp_bat **);
+static void acmp_task(void *, unsigned);
+static int acmp_icmp(const void *, const void *);
+static void acmp_free(struct acmp_bat *);
+
+static struct pool *acmp_pool;
+static unsigned acmp_nthr, acmp_ntask;
+/* Newest first.  Locked with pool_lock(). */
+static struct acmp_bat *acmp_bats;
+/* Batch which is filled by build_diff_db() */
+static struct acmp_bat *acmp_new;
+static size_t acmp_ndone;
+/* Pending entries in the viewport */
+static struct filediff **acmp_vp;
+static unsigned acmp_nvp, acmp_vpsiz;
+/* {acmp_bat} for acmp_icmp() */
+static struct acmp_bat *acmp_sort;
+static bool acmp_tmoset;
+
+/* 1: Asynchronous compare can be used */
+
+int
+acmp_init(void)
+{
+	static bool err;
+
+	if (!acmp_pool && !err) {
+		acmp_nthr = pool_nworkers();
+
+		if (!(acmp_pool = pool_new(acmp_nthr))) {
+			err = TRUE;
+		}
+	}
+
+	return acmp_pool ? 1 : 0;
+}
+
+/* Adds a job to the batch of the directory which is currently read */
+
+void
+acmp_add(struct filediff *f, const char *lpth, const char *rpth)
+{
+	struct acmp_bat *b;
+	struct acmp_job *j;
+
+	if (!(b = acmp_new)) {
+		b = acmp_new = calloc(1, sizeof(struct acmp_bat));
+	}
+
+	if (b->num == b->siz) {
+		b->siz = b->siz ? 2 * b->siz : 64;
+		b->v = realloc(b->v, b->siz * sizeof(struct acmp_job));
+	}
+
+	j = &b->v[b->num++];
+	memset(j, 0, sizeof(struct acmp_job));
+	j->f = f;
+	j->pth[0] = strdup(lpth);
+	j->pth[1] = strdup(rpth);
+}
+
+/* Starts the jobs which had been added by acmp_add().  Called after the
+ * list had been built. */
+
+void
+acmp_start(void)
+{
+	struct acmp_bat *b;
+	size_t i;
+
+	if (!(b = acmp_new)) {
+		return;
+	}
+
+	acmp_new = NULL;
+	b->ix = malloc(b->num * sizeof(size_t));
+
+	for (i = 0; i < b->num; i++) {
+		b->ix[i] = i;
+	}
+
+	acmp_sort = b;
+	qsort(b->ix, b->num, sizeof(size_t), acmp_icmp);
+	b->open = b->num;
+	b->list = db_list[right_col];
+	pool_lock(acmp_pool);
+	b->next = acmp_bats;
+	acmp_bats = b;
+
+	while (acmp_ntask < acmp_nthr) {
+		acmp_ntask++;
+		pool_add(acmp_pool, POOL_MAIN, acmp_task, NULL);
+	}
+
+	pool_unlock(acmp_pool);
+}
+
+/* Called for a pending entry which is freed */
+
+void
+acmp_drop(struct filediff *f)
+{
+	struct acmp_job *j;
+	struct acmp_bat *b;
+
+	if (!acmp_pool) {
+		return;
+	}
+
+	pool_lock(acmp_pool);
+
+	if (!(j = acmp_find(f, &b))) {
+		goto unlock;
+	}
+
+	/* The list is freed */
+	b->refilt = 0;
+
+	switch (j->st) {
+	case ACMP_RUN:
+		/* acmp_task() sets ACMP_FREE */
+		j->stop = 1;
+		break;
+	case ACMP_DONE:
+		acmp_ndone--;
+		/* fall through */
+	case ACMP_QUEUE:
+		j->st = ACMP_FREE;
+		b->open--;
+	}
+
+unlock:
+	pool_unlock(acmp_pool);
+}
+
+/* !0: Compares are pending */
+
+int
+acmp_busy(void)
+{
+	return acmp_bats || acmp_new;
+}
+
+/* Sets the results of the finished jobs in the list and updates the
+ * screen.  Tells the workers which entries are visible.  Sets a getch()
+ * timeout while jobs are pending. */
+
+void
+acmp_poll(void)
+{
+	struct acmp_bat *b, **bp;
+	struct filediff **l, *f;
+	struct acmp_job *j;
+	unsigned i, n;
+	size_t k;
+	bool redraw = FALSE, refilt = FALSE, busy = FALSE;
+	char *err = NULL;
+
+	if (!acmp_bats) {
+		return;
+	}
+
+	l = db_list[right_col];
+	n = db_num[right_col] > top_idx[right_col] ?
+	    db_num[right_col] - top_idx[right_col] : 0;
+
+	if (n > listh) {
+		n = listh;
+	}
+
+	pool_lock(acmp_pool);
+
+	if (n > acmp_vpsiz) {
+		acmp_vp = realloc(acmp_vp,
+		    (acmp_vpsiz = n) * sizeof(struct filediff *));
+	}
+
+	for (acmp_nvp = i = 0; i < n; i++) {
+		if ((f = l[top_idx[right_col] + i])->diff == '?') {
+			acmp_vp[acmp_nvp++] = f;
+		}
+	}
+
+	for (b = acmp_bats; b && acmp_ndone; b = b->next) {
+		for (k = 0; k < b->num && acmp_ndone; k++) {
+			if ((j = &b->v[k])->st != ACMP_DONE) {
+				continue;
+			}
+
+			f = j->f;
+			f->diff = j->res == 1 ? '!' : j->res ? '-' : ' ';
+			j->st = ACMP_FREE;
+			b->open--;
+			acmp_ndone--;
+
+			if (j->err) {
+				if (!err && !ign_diff_errs) {
+					err = j->err;
+				} else {
+					free(j->err);
+				}
+
+				j->err = NULL;
+			}
+
+			if (b->list != l) {
+				if (noequal || real_diff) {
+					b->refilt = 1;
+				}
+
+				continue;
+			}
+
+			if ((noequal || real_diff) && f->diff != '!') {
+				refilt = TRUE;
+			}
+
+			for (i = 0; i < acmp_nvp && !redraw; i++) {
+				if (acmp_vp[i] == f) {
+					redraw = TRUE;
+				}
+			}
+		}
+	}
+
+	for (bp = &acmp_bats; (b = *bp); ) {
+		if (b->refilt && b->list == l) {
+			refilt = TRUE;
+			b->refilt = 0;
+		}
+
+		if (b->open) {
+			busy = TRUE;
+		}
+
+		if (!b->open && !b->refilt) {
+			*bp = b->next;
+			acmp_free(b);
+		} else {
+			bp = &b->next;
+		}
+	}
+
+	pool_unlock(acmp_pool);
+
+	if (refilt) {
+		re_sort_list();
+	} else if (redraw) {
+		disp_list(2);
+	}
+
+	if (err) {
+		printerr(NULL, "%s", err);
+		free(err);
+	}
+
+	if (busy) {
+		timeout(ACMP_TMO);
+		acmp_tmoset = TRUE;
+	} else {
+		acmp_notmo();
+	}
+}
+
+/* Resets the getch() timeout of acmp_poll() */
+
+void
+acmp_notmo(void)
+{
+	if (acmp_tmoset) {
+		timeout(-1);
+		acmp_tmoset = FALSE;
+	}
+}
+
+/* Returns the next job.  Visible entries first, then list order.  Called
+ * locked. */
+
+static struct acmp_job *
+acmp_next(struct acmp_bat **bp)
+{
+	struct acmp_bat *b;
+	struct acmp_job *j;
+	unsigned i;
+
+	for (i = 0; i < acmp_nvp; i++) {
+		if ((j = acmp_find(acmp_vp[i], bp)) && j->st == ACMP_QUEUE) {
+			return j;
+		}
+	}
+
+	for (b = acmp_bats; b; b = b->next) {
+		while (b->nxt < b->num) {
+			j = &b->v[b->nxt++];
+
+			if (j->st == ACMP_QUEUE) {
+				*bp = b;
+				return j;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* Called locked */
+
+static struct acmp_job *
+acmp_find(struct filediff *f, struct acmp_bat **bp)
+{
+	struct acmp_bat *b;
+	size_t lo, hi, m;
+	struct acmp_job *j;
+
+	for (b = acmp_bats; b; b = b->next) {
+		for (lo = 0, hi = b->num; lo < hi; ) {
+			m = (lo + hi) / 2;
+			j = &b->v[b->ix[m]];
+
+			if (j->f == f) {
+				*bp = b;
+				return j;
+			} else if ((uintptr_t)j->f < (uintptr_t)f) {
+				lo = m + 1;
+			} else {
+				hi = m;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* Runs jobs until none is left */
+
+static void
+acmp_task(void *arg, unsigned w)
+{
+	struct acmp_job *j;
+	struct acmp_bat *b;
+	struct fcmp fc;
+	char *buf;
+	int r;
+
+	(void)arg;
+	(void)w;
+	memset(&fc, 0, sizeof fc);
+	buf = malloc(BUF_SIZE);
+	pool_lock(acmp_pool);
+
+	while ((j = acmp_next(&b))) {
+		j->st = ACMP_RUN;
+		pool_unlock(acmp_pool);
+		r = fcmp_data(&fc, j->pth[0], j->pth[1], buf, BUF_SIZE,
+		    &j->stop);
+		pool_lock(acmp_pool);
+
+		if (j->stop) {
+			j->st = ACMP_FREE;
+			b->open--;
+			continue;
+		}
+
+		j->res = r;
+
+		if (r == -1) {
+			j->err = strdup(buf);
+		}
+
+		j->st = ACMP_DONE;
+		acmp_ndone++;
+	}
+
+	acmp_ntask--;
+	pool_unlock(acmp_pool);
+	free(buf);
+	fcmp_free(&fc);
+}
+
+static int
+acmp_icmp(const void *a, const void *b)
+{
+	uintptr_t x = (uintptr_t)acmp_sort->v[*(const size_t *)a].f;
+	uintptr_t y = (uintptr_t)acmp_sort->v[*(const size_t *)b].f;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static void
+acmp_free(struct acmp_bat *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->num; i++) {
+		free(b->v[i].pth[0]);
+		free(b->v[i].pth[1]);
+		free(b->v[i].err);
+	}
+
+	free(b->v);
+	free(b->ix);
+	free(b);
+}
@@ -0,0 +1,7 @@
+int acmp_init(void);
+void acmp_add(struct filediff *, const char *, const char *);
+void acmp_start(void);
+void acmp_drop(struct filediff *);
+int acmp_busy(void);
+void acmp_poll(void);
+void acmp_notmo(void);
@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Arena allocator.  Objects with the same lifetime (the entries of a
+ * directory listing) are allocated in large blocks and all released at
+ * once.  Single objects cannot be freed.  Not thread-safe. */
+
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+/* Alignment of arena objects */
+union arena_algn {
+	long l;
+	long long ll;
+	double d;
+	void *p;
+};
+
+#define ARENA_ALGN sizeof(union arena_algn)
+#define ARENA_RND(n) (((n) + ARENA_ALGN - 1) / ARENA_ALGN * ARENA_ALGN)
+#define ARENA_HDR ARENA_RND(sizeof(struct arena_blk))
+#define ARENA_MIN (16 * 1024)
+#define ARENA_MAX (1024 * 1024)
+
+struct arena_blk {
+	struct arena_blk *next;
+	size_t siz; /* usable size */
+};
+
+/* Returns {n} bytes of memory aligned for any object */
+
+void *
+arena_alloc(struct arena *a, size_t n)
+{
+	struct arena_blk *b;
+	size_t s;
+	char *p;
+
+	n = ARENA_RND(n);
+
+	if (!(b = a->blk) || a->used + n > b->siz) {
+		/* Block size grows with the arena */
+		s = a->tot < ARENA_MIN ? ARENA_MIN :
+		    a->tot > ARENA_MAX ? ARENA_MAX : a->tot;
+
+		if (n > s / 4) {
+			/* Own block for large objects, the current block
+			 * stays in use */
+			b = malloc(ARENA_HDR + n);
+			b->siz = n;
+			a->tot += n;
+
+			if (a->blk) {
+				b->next = a->blk->next;
+				a->blk->next = b;
+			} else {
+				b->next = NULL;
+				a->blk = b;
+				a->used = n;
+			}
+
+			return (char *)b + ARENA_HDR;
+		}
+
+		b = malloc(ARENA_HDR + s);
+		b->siz = s;
+		b->next = a->blk;
+		a->blk = b;
+		a->used = 0;
+		a->tot += s;
+	}
+
+	p = (char *)b + ARENA_HDR + a->used;
+	a->used += n;
+	return p;
+}
+
+char *
+arena_strdup(struct arena *a, const char *s)
+{
+	size_t l = strlen(s) + 1;
+
+	return memcpy(arena_alloc(a, l), s, l);
+}
+
+/* Releases {p} if it is the last object allocated in {a} */
+
+void
+arena_rel(struct arena *a, void *p)
+{
+	char *b;
+
+	if (!a->blk) {
+		return;
+	}
+
+	b = (char *)a->blk + ARENA_HDR;
+
+	if ((char *)p >= b && (char *)p < b + a->used) {
+		a->used = (char *)p - b;
+	}
+}
+
+/* Releases all memory of {a} */
+
+void
+arena_free(struct arena *a)
+{
+	struct arena_blk *b;
+
+	while ((b = a->blk)) {
+		a->blk = b->next;
+		free(b);
+	}
+
+	memset(a, 0, sizeof(struct arena));
+}
@@ -0,0 +1,12 @@
+struct arena_blk;
+
+struct arena {
+	struct arena_blk *blk; /* current block first */
+	size_t used; /* bytes used in {blk} */
+	size_t tot; /* size of all blocks */
+};
+
+void *arena_alloc(struct arena *, size_t);
+char *arena_strdup(struct arena *, const char *);
+void arena_rel(struct arena *, void *);
+void arena_free(struct arena *);
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Time of a content search: Starts "vddiff -r -G pattern ... directory"
+# in a tmux(1) session and measures the time until the filtered list is
+# shown.  ~/.vddiffrc is not read.
+#
+# usage: gqbench.sh [-n runs] vddiff directory pattern ...
+#
+# Each pattern is passed with its own option -G.  Prints the time of
+# each run and the median in ms.  For comparable times run it twice and
+# use the second result, the first one may read the files from disk.
+
+runs=5
+
+if [ "$1" = -n ]; then
+	runs=$2
+	shift 2
+fi
+
+if [ $# -lt 3 ]; then
+	echo "usage: $0 [-n runs] vddiff directory pattern ..." >&2
+	exit 1
+fi
+
+bin=$1
+dir=$2
+shift 2
+args=
+for p in "$@"; do
+	args="$args -G '$(printf %s "$p" | sed "s/'/'\\\\''/g")'"
+done
+
+home=$(mktemp -d) || exit 1
+sess=gqbench$$
+trap 'tmux kill-session -t $sess 2>/dev/null; rm -rf "$home"' 0 1 2 15
+
+ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+i=0
+all=
+while [ $i -lt $runs ]; do
+	t0=$(ms)
+	tmux new-session -d -s $sess -x 100 -y 30 \
+	    "env HOME=$home $bin -r $args $dir; sleep 60"
+	# List entries are indented, an empty result is reported
+	while ! tmux capture-pane -p -t $sess 2>/dev/null |
+	    grep -q '^[ !<>=] [ /] \|^  [^ ]\|No file in list'; do
+		sleep 0.01
+	done
+	t=$(($(ms) - t0))
+	tmux kill-session -t $sess
+	echo "run $((i + 1)): $t ms"
+	all="$all $t"
+	i=$((i + 1))
+done
+
+echo $all | tr ' ' '\n' | sort -n | awk '{ v[NR] = $1 }
+    END { print "median: " v[int((NR + 1) / 2)] " ms" }'
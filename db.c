@@ -19,13 +19,12 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <pwd.h>
-#include <grp.h>
 #include <ctype.h>
 #include <search.h>
 #include <regex.h>
 #include <stdarg.h>
 #include <signal.h>
+#include <stdint.h>
 #ifdef USE_SYS_SYSMACROS_H
 # include <sys/sysmacros.h>
 #endif
@@ -44,16 +43,63 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "tc.h"
 #include "dl.h"
 #include "misc.h"
+#include "arena.h"
+#include "lcache.h"
+
+/* diff_db_vsort() */
+struct sort_key {
+	uint64_t pfx; /* first 8 bytes of the name (case-folded for
+	               * sortic) */
+	uint64_t val; /* mtime seconds or size */
+	uint32_t nsec;
+	unsigned cls; /* 0 for "..", else directory or file class */
+	struct filediff *f;
+};
+
+/* Directories which contain differences (option -r), by (st_dev, st_ino).
+ * Lists store both for directories, so the list display needs no system
+ * call to look them up.  NULL is an empty DB. */
+struct ddir_db {
+	struct ddir_ent **tbl;
+	size_t num; /* entries */
+	size_t siz; /* buckets, power of 2 */
+};
+
+struct ddir_ent {
+	struct ddir_ent *next;
+	dev_t dev;
+	ino_t ino;
+};
+
+/* Column widths of a list */
+struct col_wid {
+	off_t siz;
+	unsigned long major, minor;
+	size_t usr, grp; /* longest user and group name */
+};
 
 static void db_dl_free(char **);
+static void diff_db_vsort(struct filediff **, unsigned);
+static void perm_keep(int, int);
+static unsigned filt_cat(struct filediff *);
+static void filt_gq(struct filediff **, unsigned);
+static void filt_gq_res(void *, int);
+static void filt_mk_tbl(void);
+static void filt_chk(int);
+static void wid_add(struct col_wid *, struct filediff *, unsigned);
+static struct ddir_ent **ddir_slot(struct ddir_db *, dev_t, ino_t);
+static void ddir_grow(struct ddir_db *);
+static unsigned wid_need(void);
+static void wid_set(int, struct col_wid *);
+static void set_sort_key(struct sort_key *, struct filediff *);
+static unsigned key_byte(const struct sort_key *, int);
+static int key_cmp(const void *, const void *);
+static int key_name_cmp(const void *, const void *);
 #ifdef HAVE_LIBAVLBST
 static void *db_new(int (*)(union bst_val, union bst_val));
 static int name_cmp(union bst_val, union bst_val);
-static int diff_cmp(union bst_val, union bst_val);
 static int ddl_cmp(union bst_val, union bst_val);
 static int bdl_cmp(union bst_val, union bst_val);
-static void mk_list(struct bst_node *);
-static void diff_db_delete(struct bst_node *);
 static void del_strs(struct bst_node *);
 static void mk_ddl(struct bst_node *);
 static void mk_bdl(struct bst_node *);
@@ -65,14 +111,12 @@ struct curs_pos {
 };
 
 static int name_cmp(const void *, const void *);
-static int diff_cmp(const void *, const void *);
 static int curs_cmp(const void *, const void *);
 static int ext_cmp(const void *, const void *);
 static int uz_cmp(const void *, const void *);
 static int ptr_db_cmp(const void *, const void *);
 static int ddl_cmp(const void *, const void *);
 static int bdl_cmp(const void *, const void *);
-static void mk_list(const void *, const VISIT, const int);
 static void mk_ddl(const void *, const VISIT, const int);
 static void mk_bdl(const void *, const VISIT, const int);
 static void mk_str_list(const void *, const VISIT, const int);
@@ -81,16 +125,11 @@ static void mk_str_list(const void *, const VISIT, const int);
 enum sorting sorting;
 unsigned db_num[2];
 struct filediff **db_list[2];
-static struct filediff **cur_list;
-static size_t tusrlen, tgrplen;
 size_t usrlen[2], grplen[2];
-static off_t maxsiz;
-static unsigned long maxmajor, maxminor;
 unsigned short bsizlen[2];
 unsigned short majorlen[2], minorlen[2];
 short noequal, real_diff;
-void *scan_db;
-void *name_db;
+struct ddir_db *scan_db;
 void *skipext_db;
 void *uz_path_db;
 static void *alias_db;
@@ -102,14 +141,66 @@ static void *uz_ext_db;
 static unsigned db_idx, tot_db_num[2];
 static char **str_list;
 static struct scan_db *scan_db_list;
+/* List entries in the order of diff_db_add(), sorted by diff_db_sort().
+ * tot_db_num is the number of entries. */
+static struct filediff **diff_db[2];
+static unsigned diff_db_siz[2]; /* allocated */
+static bool diff_db_unsorted[2];
+/* diff_db sorted for each sort mode (SORT_MODE()), built on first use.
+ * The first one is diff_db itself, sorted in place. */
+static struct filediff **diff_perm[2][SORT_MODES];
+/* Memory of the list entries of diff_db */
+static struct arena diff_arena[2];
+
+/* The filters ('!', 'c', '&', '^', find and grep) only depend on a few
+ * properties of an entry.  filt_cat() computes them once per entry and
+ * stores them as bits in filediff.cat, the FDCV_ bits tell which ones
+ * are known.  The costly ones (is_diff_dir(), regexec(), gq_proc()) are
+ * only computed when a filter needs them.  filt_tbl has the filter
+ * result for each combination of bits and is rebuilt from the filter
+ * settings by each diff_db_sort().  Toggling a filter then only takes
+ * a table lookup per entry.  The pattern bits are dropped by filt_chk()
+ * when the find or grep pattern changes. */
+
+#define FDC_L     1   /* left file present */
+#define FDC_R     2   /* right file present */
+#define FDC_LDIR  4
+#define FDC_RDIR  8
+#define FDC_TYPE  16  /* left and right file type differ */
+#define FDC_DDIR  32  /* is_diff_dir() */
+#define FDC_NAME  64  /* name matches find pattern */
+#define FDC_GQ    128 /* content matches grep pattern */
+#define FDC_DIFF  256 /* '!' or '?', not stored in filediff.cat */
+#define FDC_NUM   512
+
+#define FDCV_BASE 512
+#define FDCV_DDIR 1024
+#define FDCV_NAME 2048
+#define FDCV_GQ   4096
+
+static unsigned char filt_tbl[FDC_NUM];
+/* gq_gen of the FDC_NAME and FDC_GQ bits of list {i} */
+static unsigned filt_gen[2];
+/* filt_cat() queues the content search with gq_add() */
+static bool filt_defer;
+
+#define WID_BSIZ 1
+#define WID_OWN  2
+#define WID_GRP  4
+
+/* Widths of all entries of list {i}, updated by diff_db_add() for the
+ * columns in all_wid_ok[i] (WID_ flags) */
+static struct col_wid all_wid[2];
+static unsigned char all_wid_ok[2];
+/* diff_db_part(): Entries of diff_db which had been looked at, allocated
+ * size of db_list, widths of the entries in db_list */
+static unsigned part_n, part_siz;
+static struct col_wid part_wid;
 
 #ifdef HAVE_LIBAVLBST
-static struct bst diff_db[2] = { { NULL, diff_cmp },
-                                 { NULL, diff_cmp } };
 static struct bst ddl_db = { NULL, ddl_cmp };
 static struct bst bdl_db = { NULL, bdl_cmp };
 #else
-static void *diff_db[2];
 static void *ddl_db;
 static void *bdl_db;
 #endif
@@ -118,8 +209,6 @@ static void *bdl_db;
 void
 db_init(void)
 {
-	scan_db    = db_new(name_cmp);
-	name_db    = db_new(name_cmp);
 	curs_db[0] = db_new(name_cmp);
 	curs_db[1] = db_new(name_cmp);
 	ext_db     = db_new(name_cmp);
@@ -448,9 +537,6 @@ push_scan_db(bool os)
 
 	if (os) {
 		one_scan = TRUE;
-#ifdef HAVE_LIBAVLBST
-		scan_db = db_new(name_cmp);
-#endif
 	}
 }
 
@@ -463,9 +549,6 @@ pop_scan_db(void)
 	fprintf(debug, "<>pop_scan_db()\n");
 #endif
 	free_scan_db(FALSE);
-#ifdef HAVE_LIBAVLBST
-	free(scan_db);
-#endif
 
 	if (!(p = scan_db_list)) {
 		return;
@@ -479,23 +562,128 @@ pop_scan_db(void)
 void
 free_scan_db(bool os)
 {
-#ifdef HAVE_LIBAVLBST
-	struct bst_node *n;
-#else
-	char *n;
-#endif
+	struct ddir_ent *e, *n;
+	size_t i;
 
 #if defined(TRACE)
 	fprintf(debug, "<>free_scan_db(%d)\n", os ? 1 : 0);
 #endif
 
-	while ((n = str_db_get_node(scan_db))) {
-		str_db_del(&scan_db, n);
+	if (scan_db) {
+		for (i = 0; i < scan_db->siz; i++) {
+			for (e = scan_db->tbl[i]; e; e = n) {
+				n = e->next;
+				free(e);
+			}
+		}
+
+		free(scan_db->tbl);
+		free(scan_db);
+		scan_db = NULL;
 	}
 
 	one_scan = os;
 }
 
+/* Adds directory {dev}, {ino} to the scan DB.  Returns 0 if it had already
+ * been there. */
+
+int
+ddir_add(dev_t dev, ino_t ino)
+{
+	struct ddir_ent **p, *e;
+
+	if (!scan_db) {
+		scan_db = calloc(1, sizeof(struct ddir_db));
+	}
+
+	if (scan_db->num >= scan_db->siz) {
+		ddir_grow(scan_db);
+	}
+
+	if (*(p = ddir_slot(scan_db, dev, ino))) {
+		return 0;
+	}
+
+	e = malloc(sizeof(struct ddir_ent));
+	e->next = NULL;
+	e->dev = dev;
+	e->ino = ino;
+	*p = e;
+	scan_db->num++;
+	return 1;
+}
+
+/* Returns 1 if directory {dev}, {ino} contains differences */
+
+int
+ddir_srch(dev_t dev, ino_t ino)
+{
+	if (!scan_db || !scan_db->num) {
+		return 0;
+	}
+
+	return *ddir_slot(scan_db, dev, ino) ? 1 : 0;
+}
+
+void
+ddir_del(dev_t dev, ino_t ino)
+{
+	struct ddir_ent **p, *e;
+
+	if (!scan_db || !scan_db->num ||
+	    !(e = *(p = ddir_slot(scan_db, dev, ino)))) {
+		return;
+	}
+
+	*p = e->next;
+	free(e);
+	scan_db->num--;
+}
+
+/* Returns the link to the entry for {dev}, {ino} or to the end of its
+ * bucket */
+
+static struct ddir_ent **
+ddir_slot(struct ddir_db *d, dev_t dev, ino_t ino)
+{
+	struct ddir_ent **p;
+	uint64_t h;
+
+	h = ((uint64_t)ino ^ ((uint64_t)dev << 32)) *
+	    UINT64_C(0x9e3779b97f4a7c15);
+	p = &d->tbl[(h >> 32) & (d->siz - 1)];
+
+	while (*p && ((*p)->ino != ino || (*p)->dev != dev)) {
+		p = &(*p)->next;
+	}
+
+	return p;
+}
+
+static void
+ddir_grow(struct ddir_db *d)
+{
+	struct ddir_db n;
+	struct ddir_ent *e, *e2;
+	size_t i;
+
+	n.siz = d->siz ? d->siz * 2 : 64;
+	n.tbl = calloc(n.siz, sizeof(struct ddir_ent *));
+
+	for (i = 0; i < d->siz; i++) {
+		for (e = d->tbl[i]; e; e = e2) {
+			e2 = e->next;
+			e->next = NULL;
+			*ddir_slot(&n, e->dev, e->ino) = e;
+		}
+	}
+
+	free(d->tbl);
+	d->tbl = n.tbl;
+	d->siz = n.siz;
+}
+
 /****************
  * unzip ext DB *
  ****************/
@@ -792,80 +980,553 @@ curs_cmp(const void *a, const void *b)
  * diff DB *
  ***********/
 
+/* Only the permutation of the current sort mode is kept for stored
+ * lists */
+
 void
 diff_db_store(struct ui_state *st)
 {
-#ifdef HAVE_LIBAVLBST
-	st->bst = diff_db->root;
-	diff_db->root = NULL;
-#else
+	int m = SORT_MODE();
+
+	perm_keep(0, diff_perm[0][m] ? m : -1);
+	st->sortm = diff_perm[0][m] ? m : -1;
+	diff_perm[0][m] = NULL;
 	st->bst = *diff_db;
 	*diff_db = NULL;
-#endif
+	*diff_db_siz = 0;
 	st->num = *db_num;
 	*db_num = 0;
+	st->tot = *tot_db_num;
+	*tot_db_num = 0;
 	st->list = *db_list;
 	*db_list = NULL;
 	st->mmrkd = *mmrkd;
 	*mmrkd = 0;
+	st->arena = malloc(sizeof(struct arena));
+	*st->arena = *diff_arena;
+	memset(diff_arena, 0, sizeof(struct arena));
 }
 
 void
 diff_db_restore(struct ui_state *st)
 {
 	diff_db_free(0);
-#ifdef HAVE_LIBAVLBST
-	diff_db->root = st->bst;
-#else
 	*diff_db = st->bst;
-#endif
 	*db_num = st->num;
+	*tot_db_num = st->tot;
+	*diff_db_siz = st->tot;
+
+	if (st->sortm >= 0) {
+		diff_perm[0][st->sortm] = *diff_db;
+	}
+
 	*db_list = st->list;
 	*mmrkd = st->mmrkd;
+	*diff_arena = *st->arena;
+	free(st->arena);
+	/* The scan results may have changed meanwhile */
+	diff_db_filt_reset(0);
+	all_wid_ok[0] = 0;
+}
+
+/* Frees a listing saved by diff_db_store() which is not restored */
+
+void
+diff_db_st_free(struct ui_state *st)
+{
+	unsigned n;
+
+	for (n = 0; n < st->tot; n++) {
+		free_diff(((struct filediff **)st->bst)[n]);
+	}
+
+	free(st->bst);
+	free(st->list);
+	arena_free(st->arena);
+	free(st->arena);
+}
+
+/* Returns TRUE if the displayed list has entries with a pending
+ * compare (see acmp.c) */
+
+bool
+diff_db_pend(void)
+{
+	unsigned n;
+
+	for (n = 0; n < *tot_db_num; n++) {
+		if ((*diff_db)[n]->diff == '?') {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Reports the memory used by the entries of the current list and of
+ * the lists on the directory stack */
+
+void
+diff_db_mem(void)
+{
+	struct ui_state *st;
+	size_t cb, sb, num, cold;
+	unsigned sn, n;
+	int i, m;
+
+	num = 0;
+	cold = 0;
+	cb = 0;
+
+	for (i = 0; i < 2; i++) {
+		for (n = 0; n < tot_db_num[i]; n++) {
+			if (diff_db[i][n]->cold) {
+				cold++;
+			}
+		}
+
+		num += tot_db_num[i];
+		cb += diff_arena[i].tot +
+		    diff_db_siz[i] * sizeof(struct filediff *);
+
+		for (m = 0; m < SORT_MODES; m++) {
+			if (diff_perm[i][m] && diff_perm[i][m] != diff_db[i]) {
+				cb += tot_db_num[i] *
+				    sizeof(struct filediff *);
+			}
+		}
+
+		if (db_list[i]) {
+			cb += tot_db_num[i] * sizeof(struct filediff *);
+		}
+	}
+
+	for (sn = 0, sb = 0, st = ui_stack; st; st = st->next, sn++) {
+		sb += st->arena->tot;
+
+		sb += st->tot * sizeof(struct filediff *);
+
+		if (st->list) {
+			sb += st->tot * sizeof(struct filediff *);
+		}
+	}
+
+	printerr(NULL, "%lu entries (%lu with cold part), %lu+%lu bytes "
+	    "each, %lu KiB; %u stacked lists, %lu KiB",
+	    (unsigned long)num, (unsigned long)cold,
+	    (unsigned long)sizeof(struct filediff),
+	    (unsigned long)sizeof(struct fdcold),
+	    (unsigned long)(cb / 1024), sn, (unsigned long)(sb / 1024));
+}
+
+/* Arena for the entries of list {i} */
+
+struct arena *
+diff_db_arena(int i)
+{
+	return &diff_arena[i];
+}
+
+/* Returns the index into filt_tbl for {f}.  Computes the bits which
+ * are needed by the current filter settings and are not yet known. */
+
+static unsigned
+filt_cat(struct filediff *f)
+{
+	unsigned c = f->cat;
+	bool dd;
+
+	if (!(c & FDCV_BASE)) {
+		c |= FDCV_BASE;
+
+		if (f->type[0]) {
+			c |= FDC_L;
+		}
+
+		if (f->type[1]) {
+			c |= FDC_R;
+		}
+
+		if (S_ISDIR(f->type[0])) {
+			c |= FDC_LDIR;
+		}
+
+		if (S_ISDIR(f->type[1])) {
+			c |= FDC_RDIR;
+		}
+
+		if ((f->type[0] & S_IFMT) != (f->type[1] & S_IFMT)) {
+			c |= FDC_TYPE;
+		}
+	}
+
+	/* Same condition as in is_diff_dir() */
+	if (recursive && (c & (FDC_LDIR | FDC_RDIR)) &&
+	    (file_pattern || (!bmode && !fmode && (noequal || real_diff)))) {
+		if (!(c & FDCV_DDIR)) {
+			c |= FDCV_DDIR;
+
+			if (is_diff_dir(f)) {
+				c |= FDC_DDIR;
+			}
+		}
+
+		dd = c & FDC_DDIR ? TRUE : FALSE;
+	} else {
+		dd = c & (FDC_LDIR | FDC_RDIR) ? TRUE : FALSE;
+	}
+
+	/* Directories with differences are not searched */
+	if (file_pattern && !dd) {
+		if (find_name && !(c & FDCV_NAME)) {
+			c |= FDCV_NAME;
+
+			if (!fn_match(f->name)) {
+				c |= FDC_NAME;
+			}
+		}
+
+		if (gq_pattern && !(c & FDCV_GQ) &&
+		    (!find_name || (c & FDC_NAME))) {
+			if (filt_defer) {
+				gq_add(f, f); /* see filt_gq_res() */
+			} else {
+				c |= FDCV_GQ;
+
+				if (!gq_proc(f)) {
+					c |= FDC_GQ;
+				}
+			}
+		}
+	}
+
+	f->cat = c;
+	c &= FDC_NUM - 1;
+
+	/* Entries with a pending compare ('?', see acmp.c) pass the
+	 * filters until the result is known */
+	if (f->diff == '!' || f->diff == '?') {
+		c |= FDC_DIFF;
+	}
+
+	return c;
+}
+
+/* Computes the bits of filt_cat() for the entries {v}[0..{n}).  The
+ * files for the content search are searched in parallel. */
+
+static void
+filt_gq(struct filediff **v, unsigned n)
+{
+	size_t m;
+	unsigned k;
+
+	if (!gq_pattern) {
+		return;
+	}
+
+	m = gq_mark();
+	filt_defer = TRUE;
+
+	for (k = 0; k < n; k++) {
+		filt_cat(v[k]);
+	}
+
+	filt_defer = FALSE;
+	gq_wait(m, filt_gq_res);
+}
+
+static void
+filt_gq_res(void *a, int r)
+{
+	struct filediff *f = a;
+
+	f->cat |= FDCV_GQ;
+
+	if (!r) {
+		f->cat |= FDC_GQ;
+	}
+}
+
+/* Evaluates the filters for each value of filt_cat() */
+
+static void
+filt_mk_tbl(void)
+{
+	unsigned c;
+	bool ldir, dd;
+
+	for (c = 0; c < FDC_NUM; c++) {
+		ldir = c & FDC_LDIR ? TRUE : FALSE;
+		dd = !recursive || (c & FDC_DDIR);
+
+		filt_tbl[c] =
+		    (!file_pattern ||
+		     ((c & (FDC_LDIR | FDC_RDIR)) && dd) ||
+		     ((!find_name || (c & FDC_NAME)) &&
+		      (!gq_pattern || (c & FDC_GQ)))) &&
+
+		    (bmode || fmode ||
+		     ((!noequal ||
+		       (c & (FDC_DIFF | FDC_TYPE)) ||
+		       (ldir && dd))
+		      &&
+		      (!real_diff ||
+		       (c & FDC_DIFF) ||
+		       (ldir && (c & FDC_RDIR) && dd))
+		      &&
+		      (!nosingle ||
+		        /* no right without left */
+		       ((!(nosingle & 2) || (c & FDC_L)) &&
+		        /* no left without right */
+		        (!(nosingle & 1) || (c & FDC_R))))
+		      &&
+		      (!excl_or ||
+		       !(c & FDC_L) != !(c & FDC_R))));
+	}
+}
+
+/* Invalidates the is_diff_dir() and pattern results of list {i}, e.g.
+ * after changing option "recursive" or for a restored list */
+
+void
+diff_db_filt_reset(int i)
+{
+	unsigned n;
+
+	for (n = 0; n < tot_db_num[i]; n++) {
+		diff_db[i][n]->cat &= ~(FDCV_DDIR | FDC_DDIR |
+		    FDCV_NAME | FDC_NAME | FDCV_GQ | FDC_GQ);
+	}
+
+	filt_gen[i] = gq_gen;
+}
+
+/* Invalidates the pattern results of list {i} if the -F or -G patterns
+ * had been changed since they were computed */
+
+static void
+filt_chk(int i)
+{
+	unsigned n;
+
+	if (filt_gen[i] == gq_gen) {
+		return;
+	}
+
+	for (n = 0; n < tot_db_num[i]; n++) {
+		diff_db[i][n]->cat &= ~(FDCV_NAME | FDC_NAME |
+		    FDCV_GQ | FDC_GQ);
+	}
+
+	filt_gen[i] = gq_gen;
+}
+
+/* Adds the column widths needed by entry {f} to {w}.  {fl}: WID_ flags
+ * of the columns to consider. */
+
+static void
+wid_add(struct col_wid *w, struct filediff *f, unsigned fl)
+{
+	const char *s;
+	size_t l;
+	int j;
+
+	if (fl & (WID_OWN | WID_GRP)) {
+		diff_fill(f);
+	}
+
+	for (j = 0; j < 2; j++) {
+		if (!f->type[j]) {
+			continue;
+		}
+
+		if (!(fl & WID_BSIZ)) {
+		} else if (S_ISCHR(f->type[j]) || S_ISBLK(f->type[j])) {
+			if ((unsigned long)major(FD_RDEV(f, j)) > w->major) {
+				w->major = major(FD_RDEV(f, j));
+			}
+
+			if ((unsigned long)minor(FD_RDEV(f, j)) > w->minor) {
+				w->minor = minor(FD_RDEV(f, j));
+			}
+		} else if (f->siz[j] > w->siz) {
+			w->siz = f->siz[j];
+		}
+
+		if (fl & WID_OWN) {
+			l = (s = usr_name(f->cold->uid[j])) ? strlen(s) : 5;
+
+			if (l > w->usr) {
+				w->usr = l;
+			}
+		}
+
+		if (fl & WID_GRP) {
+			l = (s = grp_name(f->cold->gid[j])) ? strlen(s) : 5;
+
+			if (l > w->grp) {
+				w->grp = l;
+			}
+		}
+	}
 }
 
+/* WID_ flags of the displayed columns */
+
+static unsigned
+wid_need(void)
+{
+	return (add_bsize ? WID_BSIZ : 0) |
+	       (add_owner ? WID_OWN  : 0) |
+	       (add_group ? WID_GRP  : 0);
+}
+
+/* Sorts the entries if new ones had been added and makes the displayed
+ * list db_list of all entries which pass the filters */
+
 void
 diff_db_sort(int i)
 {
+	struct filediff **pl, **l;
+	struct col_wid w;
+	unsigned n, need;
+	int m;
+
 	db_idx = 0;
-	maxsiz = 0;
-	maxmajor = 0;
-	maxminor = 0;
-	tusrlen = 0;
-	tgrplen = 0;
+	memset(&w, 0, sizeof w);
+	need = wid_need();
 
 	if (!tot_db_num[i]) {
 		goto exit;
 	}
 
+	if (diff_db_unsorted[i]) {
+		perm_keep(i, -1);
+		diff_db_unsorted[i] = FALSE;
+		free(db_list[i]);
+		db_list[i] = NULL;
+	}
+
+	if (!(pl = diff_perm[i][m = SORT_MODE()])) {
+		int j;
+
+		for (j = 0; j < SORT_MODES && !diff_perm[i][j]; j++);
+
+		if (j == SORT_MODES) {
+			pl = diff_db[i];
+		} else {
+			pl = malloc(tot_db_num[i] * sizeof(struct filediff *));
+			memcpy(pl, diff_db[i],
+			    tot_db_num[i] * sizeof(struct filediff *));
+		}
+
+		diff_db_vsort(pl, tot_db_num[i]);
+		diff_perm[i][m] = pl;
+	}
+
 	if (!db_list[i]) {
 		db_list[i] = malloc(tot_db_num[i] * sizeof(struct filediff *));
 	}
 
-	cur_list = db_list[i];
-#ifdef HAVE_LIBAVLBST
-	mk_list(diff_db[i].root);
-#else
-	twalk(diff_db[i], mk_list);
-#endif
+	l = db_list[i];
+	filt_mk_tbl();
+	filt_chk(i);
+	filt_gq(pl, tot_db_num[i]);
+
+	for (n = 0; n < tot_db_num[i]; n++) {
+		if (filt_tbl[filt_cat(pl[n])]) {
+			l[db_idx++] = pl[n];
+		}
+	}
+
+	/* The widths of all entries are kept up to date by diff_db_add().
+	 * For a filtered list only the displayed entries count. */
+	if (db_idx == tot_db_num[i] && (all_wid_ok[i] & need) == need) {
+		w = all_wid[i];
+	} else if (need) {
+		for (n = 0; n < db_idx; n++) {
+			wid_add(&w, l[n], need);
+		}
+
+		if (db_idx == tot_db_num[i]) {
+			all_wid[i] = w;
+			all_wid_ok[i] = need;
+		}
+	}
 exit:
 	db_num[i] = db_idx;
-	usrlen[i] = tusrlen + 1; /* column separator */
-	grplen[i] = tgrplen + 1;
+	wid_set(i, &w);
+}
+
+/* Makes db_list of the entries which had been added so far, in the order
+ * of diff_db_add(), for displaying a list which is still read.  {ini}:
+ * First call for the list.  The next diff_db_sort() builds the sorted
+ * list.  Returns the number of added entries. */
+
+unsigned
+diff_db_part(int i, int ini)
+{
+	struct filediff *f;
+	unsigned need;
+
+	need = wid_need();
+
+	if (ini) {
+		free(db_list[i]);
+		db_list[i] = NULL;
+		db_num[i] = 0;
+		part_n = part_siz = 0;
+		memset(&part_wid, 0, sizeof part_wid);
+		filt_mk_tbl();
+	}
+
+	if (tot_db_num[i] > part_siz) {
+		part_siz = tot_db_num[i];
+		db_list[i] = realloc(db_list[i],
+		    part_siz * sizeof(struct filediff *));
+	}
+
+	filt_chk(i);
+	filt_gq(diff_db[i] + part_n, tot_db_num[i] - part_n);
+
+	for (; part_n < tot_db_num[i]; part_n++) {
+		if (filt_tbl[filt_cat(f = diff_db[i][part_n])]) {
+			db_list[i][db_num[i]++] = f;
+
+			if (need) {
+				wid_add(&part_wid, f, need);
+			}
+		}
+	}
+
+	wid_set(i, &part_wid);
+	return tot_db_num[i];
+}
+
+/* Sets the column widths of list {i} from the widths {w} of its entries */
+
+static void
+wid_set(int i, struct col_wid *w)
+{
+	usrlen[i] = w->usr + 1; /* column separator */
+	grplen[i] = w->grp + 1;
 
 	if (add_bsize) {
+		off_t siz = w->siz;
+		unsigned long major = w->major, minor = w->minor;
+
 		/* 5 instead of 4 for the column separator */
-		for (bsizlen[i] = 5; maxsiz >= 10000;
-		    bsizlen[i]++, maxsiz /= 10);
+		for (bsizlen[i] = 5; siz >= 10000; bsizlen[i]++, siz /= 10);
 
-		if (maxmajor || maxminor) {
+		if (major || minor) {
 			unsigned j;
 
-			for (majorlen[i] = 4; maxmajor >= 1000;
-			    majorlen[i]++, maxmajor /= 10);
+			for (majorlen[i] = 4; major >= 1000;
+			    majorlen[i]++, major /= 10);
 
-			for (minorlen[i] = 4; maxminor >= 1000;
-			    minorlen[i]++, maxminor /= 10);
+			for (minorlen[i] = 4; minor >= 1000;
+			    minorlen[i]++, minor /= 10);
 
 			j = majorlen[i] + minorlen[i] + 2;
 
@@ -876,248 +1537,216 @@ exit:
 	}
 }
 
-#define PROC_DIFF_NODE() \
-	do { \
-	if ((!file_pattern || \
-	     ((S_ISDIR(f->type[0]) || S_ISDIR(f->type[1])) && \
-	      (!recursive || is_diff_dir(f))) || \
-	     ((!find_name || !regexec(&fn_re, f->name, 0, NULL, 0)) && \
-	      (!gq_pattern || !gq_proc(f)))) && \
-	    \
-	    (bmode || fmode || \
-	     ((!noequal || \
-	       f->diff == '!' || \
-	       (S_ISDIR(f->type[0]) && (!recursive || is_diff_dir(f))) || \
-	       (f->type[0] & S_IFMT) != (f->type[1] & S_IFMT)) \
-	      && \
-	      (!real_diff || \
-	       f->diff == '!' || (S_ISDIR(f->type[0]) && S_ISDIR(f->type[1]) \
-	       && (!recursive || is_diff_dir(f)))) \
-	      && \
-	      (!nosingle || \
-	        /* no right without left */ \
-	       ((!(nosingle & 2) || f->type[0]) && \
-	        /* no left without right */ \
-	        (!(nosingle & 1) || f->type[1]))) \
-	      && \
-	      (!excl_or || \
-	       (!f->type[0] &&  f->type[1]) || \
-	       ( f->type[0] && !f->type[1]))))) \
-	{ \
-		cur_list[db_idx++] = f; \
-		\
-		if (add_bsize) { \
-			if (f->type[0]) { \
-				if (S_ISCHR(f->type[0]) || \
-				    S_ISBLK(f->type[0])) { \
-					if ((long)major(f->rdev[0]) > \
-					    (long)maxmajor) { \
-						maxmajor = major(f->rdev[0]); \
-					} \
-					\
-					if ((long)minor(f->rdev[0]) > \
-					    (long)maxminor) { \
-						maxminor = minor(f->rdev[0]); \
-					} \
-				} else if (f->siz[0] > maxsiz) { \
-					maxsiz = f->siz[0]; \
-				} \
-			} \
-			\
-			if (f->type[1]) { \
-				if (S_ISCHR(f->type[1]) || \
-				    S_ISBLK(f->type[1])) { \
-					if ((long)major(f->rdev[1]) \
-					    > (long)maxmajor) { \
-						maxmajor = major(f->rdev[1]); \
-					} \
-					\
-					if ((long)minor(f->rdev[1]) \
-					    > (long)maxminor) { \
-						maxminor = minor(f->rdev[1]); \
-					} \
-				} else if (f->siz[1] > maxsiz) { \
-					maxsiz = f->siz[1]; \
-				} \
-			} \
-		} \
-		\
-		if (add_owner) { \
-			if (f->type[0]) { \
-				if (!(pw = getpwuid(f->uid[0]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(pw->pw_name); \
-				} \
-				\
-				if (l > tusrlen) { \
-					tusrlen = l; \
-				} \
-			} \
-			\
-			if (f->type[1]) { \
-				if (!(pw = getpwuid(f->uid[1]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(pw->pw_name); \
-				} \
-				\
-				if (l > tusrlen) { \
-					tusrlen = l; \
-				} \
-			} \
-		} \
-		\
-		if (add_group) { \
-			if (f->type[0]) { \
-				if (!(gr = getgrgid(f->gid[0]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(gr->gr_name); \
-				} \
-				\
-				if (l > tgrplen) { \
-					tgrplen = l; \
-				} \
-			} \
-			\
-			if (f->type[1]) { \
-				if (!(gr = getgrgid(f->gid[1]))) { \
-					l = 5; \
-				} else { \
-					l = strlen(gr->gr_name); \
-				} \
-				\
-				if (l > tgrplen) { \
-					tgrplen = l; \
-				} \
-			} \
-		} \
-	} \
-	} while (0)
+#define IS_F_DIR(n) \
+    /* both are dirs */ \
+    (S_ISDIR(f##n->type[0]) && S_ISDIR(f##n->type[1])) || \
+    /* only left dir present */ \
+    (S_ISDIR(f##n->type[0]) && !f##n->type[1]) || \
+    /* only right dir present */ \
+    (S_ISDIR(f##n->type[1]) && !f##n->type[0])
+
+/* Precomputed sort key of a list entry.  Keys are ordered by cls, val,
+ * nsec and pfx.  Only entries with equal keys need to compare the full
+ * names. */
+
+#define SORT_KEY_BYTES 21 /* pfx 8, nsec 4, val 8, cls 1 */
+/* Below this number of entries qsort(3) is faster than the radix sort */
+#define RADIX_MIN 256
 
-#ifdef HAVE_LIBAVLBST
 static void
-mk_list(struct bst_node *n)
+set_sort_key(struct sort_key *k, struct filediff *f1)
 {
-	struct filediff *f;
-	struct passwd *pw;
-	struct group *gr;
-	size_t l;
+	const unsigned char *s = (const unsigned char *)f1->name;
+	const struct timespec *t;
+	int j;
+	bool d;
+
+	k->f = f1;
+	k->pfx = 0;
+	k->val = 0;
+	k->nsec = 0;
+
+	/* Big-endian, hence compared like strcmp(3) or strcasecmp(3) */
+	for (j = 0; j < 8; j++) {
+		k->pfx <<= 8;
+
+		if (*s) {
+			k->pfx |= sortic ? (unsigned char)tolower(*s) : *s;
+			s++;
+		}
+	}
 
-	if (!n) {
+	if (str_eq_dotdot(f1->name)) {
+		k->cls = 0;
 		return;
 	}
 
-	mk_list(n->left);
-	f = n->key.p;
-	PROC_DIFF_NODE();
-	mk_list(n->right);
-}
-#else
-static void
-mk_list(const void *n, const VISIT which, const int depth)
-{
-	struct filediff *f;
-	struct passwd *pw;
-	struct group *gr;
-	size_t l;
-
-	(void)depth;
+	k->cls = 1;
 
-	switch (which) {
-	case postorder:
-	case leaf:
-		f = *(struct filediff * const *)n;
-		PROC_DIFF_NODE();
+	switch (sorting) {
+	case SORTMTIME:
+		/* mtime may not have been requested before */
+		diff_fill(f1);
+		t = &f1->cold->mtim[f1->type[0] ? 0 : 1];
+		/* Signed to unsigned order */
+		k->val = (uint64_t)(int64_t)t->tv_sec ^ (uint64_t)1 << 63;
+		k->nsec = t->tv_nsec;
+		break;
+	case SORTSIZE:
+		d = IS_F_DIR(1);
+		k->cls = d ? 1 : 2;
+		k->val = (uint64_t)(int64_t)(f1->type[0] ? f1->siz[0] :
+		    f1->siz[1]) ^ (uint64_t)1 << 63;
+		break;
+	case DIRSFIRST:
+	case FILESFIRST:
+		d = IS_F_DIR(1);
+		k->cls = d == (sorting == DIRSFIRST) ? 1 : 2;
 		break;
 	default:
 		;
 	}
 }
-#endif
 
-#define IS_F_DIR(n) \
-    /* both are dirs */ \
-    (S_ISDIR(f##n->type[0]) && S_ISDIR(f##n->type[1])) || \
-    /* only left dir present */ \
-    (S_ISDIR(f##n->type[0]) && !f##n->type[1]) || \
-    /* only right dir present */ \
-    (S_ISDIR(f##n->type[1]) && !f##n->type[0])
+/* Byte {d} of the key, 0 is the least significant */
+
+static unsigned
+key_byte(const struct sort_key *k, int d)
+{
+	return d <  8 ? (unsigned)(k->pfx  >>  d       * 8) & 0xff :
+	       d < 12 ? (unsigned)(k->nsec >> (d -  8) * 8) & 0xff :
+	       d < 20 ? (unsigned)(k->val  >> (d - 12) * 8) & 0xff :
+	       k->cls;
+}
 
 static int
-diff_cmp(
-#ifdef HAVE_LIBAVLBST
-    union bst_val a, union bst_val b
-#else
-    const void *a, const void *b
-#endif
-    )
+key_name_cmp(const void *a, const void *b)
 {
-	const struct filediff
-#ifdef HAVE_LIBAVLBST
-	    *f1 = a.p,
-	    *f2 = b.p;
-#else
-	    *f1 = a,
-	    *f2 = b;
-#endif
-	const char *name1 = f1->name;
-	const char *name2 = f2->name;
-	const bool dotdot2 = str_eq_dotdot(name2);
-	int case_cmp_result;
+	const char *n1 = ((const struct sort_key *)a)->f->name;
+	const char *n2 = ((const struct sort_key *)b)->f->name;
+	int r;
 
-	if (str_eq_dotdot(name1)) {
-		if (dotdot2) {
-			return 0;
-		} else {
-			return -1;
+	if (sortic && (r = strcasecmp(n1, n2))) {
+		return r;
+	} else {
+		return strcmp(n1, n2);
+	}
+}
+
+static int
+key_cmp(const void *a, const void *b)
+{
+	const struct sort_key *k1 = a, *k2 = b;
+
+	if (k1->cls  != k2->cls ) return k1->cls  < k2->cls  ? -1 : 1;
+	if (k1->val  != k2->val ) return k1->val  < k2->val  ? -1 : 1;
+	if (k1->nsec != k2->nsec) return k1->nsec < k2->nsec ? -1 : 1;
+	if (k1->pfx  != k2->pfx ) return k1->pfx  < k2->pfx  ? -1 : 1;
+	return key_name_cmp(a, b);
+}
+
+/* Sorts {l} according to sorting and sortic.  Small lists are
+ * sorted with qsort(3).  Larger ones get an LSD radix sort over the key
+ * bytes, bytes which are equal in all keys are skipped.  Runs with equal
+ * keys are then sorted by the full names. */
+
+static void
+diff_db_vsort(struct filediff **l, unsigned n)
+{
+	struct sort_key *k, *k2, *t;
+	unsigned (*cnt)[256];
+	unsigned u, v, s, c;
+	int d;
+
+	k = malloc(n * sizeof(struct sort_key));
+
+	for (u = 0; u < n; u++) {
+		set_sort_key(&k[u], l[u]);
+	}
+
+	if (n < RADIX_MIN) {
+		qsort(k, n, sizeof(struct sort_key), key_cmp);
+		goto ret;
+	}
+
+	k2 = malloc(n * sizeof(struct sort_key));
+	cnt = calloc(SORT_KEY_BYTES, sizeof *cnt);
+
+	for (u = 0; u < n; u++) {
+		for (d = 0; d < SORT_KEY_BYTES; d++) {
+			cnt[d][key_byte(&k[u], d)]++;
 		}
-	} else if (dotdot2) {
-		return 1;
-	} else if (sorting == SORTMTIME) {
-		time_t t1, t2;
-
-		t1 = f1->type[0] ? f1->mtim[0] : f1->mtim[1];
-		t2 = f2->type[0] ? f2->mtim[0] : f2->mtim[1];
-
-		if      (t1 < t2) return -1;
-		else if (t1 > t2) return  1;
-
-	} else if (sorting == SORTSIZE) {
-		off_t t1, t2;
-		short f1_dir = IS_F_DIR(1),
-		      f2_dir = IS_F_DIR(2);
-		short dirsort = f1_dir && !f2_dir ? -1 :
-		                f2_dir && !f1_dir ?  1 : 0;
-
-		if (dirsort)
-			return dirsort;
-
-		t1 = f1->type[0] ? f1->siz[0] : f1->siz[1];
-		t2 = f2->type[0] ? f2->siz[0] : f2->siz[1];
-
-		if      (t1 < t2) return -1;
-		else if (t1 > t2) return  1;
-
-	} else if (sorting != SORTMIXED) {
-		short f1_dir = IS_F_DIR(1),
-		      f2_dir = IS_F_DIR(2);
-		short dirsort = f1_dir && !f2_dir ? -1 :
-		                f2_dir && !f1_dir ?  1 : 0;
-
-		if (dirsort) {
-			if (sorting == DIRSFIRST)
-				return  dirsort;
-			else
-				return -dirsort;
+	}
+
+	for (d = 0; d < SORT_KEY_BYTES; d++) {
+		if (cnt[d][key_byte(k, d)] == n) {
+			continue;
 		}
+
+		for (s = 0, c = 0; c < 256; c++) {
+			v = cnt[d][c];
+			cnt[d][c] = s;
+			s += v;
+		}
+
+		for (u = 0; u < n; u++) {
+			k2[cnt[d][key_byte(&k[u], d)]++] = k[u];
+		}
+
+		t = k;
+		k = k2;
+		k2 = t;
 	}
 
-	if (sortic && (case_cmp_result = strcasecmp(name1, name2))) {
-		return case_cmp_result;
-	} else {
-		return strcmp(name1, name2);
+	free(cnt);
+	free(k2);
+
+	for (u = 0; u < n; u = v) {
+		for (v = u + 1; v < n && k[v].cls == k[u].cls &&
+		    k[v].val == k[u].val && k[v].nsec == k[u].nsec &&
+		    k[v].pfx == k[u].pfx; v++);
+
+		if (v - u > 1) {
+			qsort(k + u, v - u, sizeof(struct sort_key),
+			    key_name_cmp);
+		}
+	}
+
+ret:
+	for (u = 0; u < n; u++) {
+		l[u] = k[u].f;
+	}
+
+	free(k);
+}
+
+/* Releases the permutations of list {i} except the one of sort mode {m}
+ * (-1: none), which becomes diff_db[i] */
+
+static void
+perm_keep(int i, int m)
+{
+	struct filediff **o = diff_db[i], **l;
+	int j;
+
+	l = m >= 0 ? diff_perm[i][m] : o;
+
+	for (j = 0; j < SORT_MODES; j++) {
+		if (diff_perm[i][j] != l && diff_perm[i][j] != o) {
+			free(diff_perm[i][j]);
+		}
+
+		diff_perm[i][j] = NULL;
+	}
+
+	if (l != o) {
+		free(o);
+		diff_db[i] = l;
+		diff_db_siz[i] = tot_db_num[i];
+	}
+
+	if (m >= 0) {
+		diff_perm[i][m] = l;
 	}
 }
 
@@ -1128,64 +1757,63 @@ diff_db_add(struct filediff *diff, int i)
 	fprintf(debug, "<>diff_db_add name(%s) ltyp 0%o rtyp 0%o\n",
 	    diff->name, diff->type[0], diff->type[1]);
 #endif
-#ifdef HAVE_LIBAVLBST
-	avl_add(&diff_db[i],
-	    (union bst_val)(void *)diff, (union bst_val)(int)0);
-#else
-	tsearch(diff, &diff_db[i], diff_cmp);
-#endif
-	tot_db_num[i]++;
+	if (!diff_db_unsorted[i]) {
+		/* Permutations may point to diff_db[i] */
+		perm_keep(i, -1);
+		diff_db_unsorted[i] = TRUE;
+	}
+
+	if (tot_db_num[i] == diff_db_siz[i]) {
+		diff_db_siz[i] = diff_db_siz[i] ? diff_db_siz[i] * 2 : 64;
+		diff_db[i] = realloc(diff_db[i],
+		    diff_db_siz[i] * sizeof(struct filediff *));
+	}
+
+	if (!tot_db_num[i]) {
+		memset(&all_wid[i], 0, sizeof(struct col_wid));
+		all_wid_ok[i] = wid_need();
+	}
+
+	diff_db[i][tot_db_num[i]++] = diff;
+
+	if (all_wid_ok[i]) {
+		wid_add(&all_wid[i], diff, all_wid_ok[i]);
+	}
 }
 
 void
 diff_db_free(int i)
 {
+	unsigned n;
+
 #if defined(TRACE)
 	fprintf(debug, "->diff_db_free(%d)\n", i);
 #endif
-#ifdef HAVE_LIBAVLBST
-	diff_db_delete(diff_db[i].root);
-	diff_db[i].root = NULL;
-#else
-	struct filediff *f;
-
-	while (diff_db[i] != NULL) {
-		f = *(struct filediff **)diff_db[i];
-		tdelete(f, &diff_db[i], diff_cmp);
-		free_diff(f);
+	for (n = 0; n < tot_db_num[i]; n++) {
+		free_diff(diff_db[i][n]);
 	}
-#endif
+
+	perm_keep(i, -1);
+	free(diff_db[i]);
+	diff_db[i] = NULL;
+	diff_db_siz[i] = 0;
+	diff_db_unsorted[i] = FALSE;
+	arena_free(&diff_arena[i]);
 	free(db_list[i]);
 	db_list[i] = NULL;
 	mmrkd[i] = 0;
 	db_num[i] = 0;
+	tot_db_num[i] = 0;
+	filt_gen[i] = gq_gen;
+
+	if (!i) {
+		lc_drop();
+	}
 #if defined(TRACE)
 	fprintf(debug, "<-diff_db_free\n");
 #endif
 }
 
-/* In the libavlbst case the nodes are not really deleted, just the memory
- * is freed after both subtrees had been visited.  This is much faster than
- * rebalancing the tree for each delete.  It is not dangerous since the tree
- * structure does not change due to the node memory free. */
-
-#ifdef HAVE_LIBAVLBST
-static void
-diff_db_delete(struct bst_node *n)
-{
-	struct filediff *f;
-
-	if (!n)
-		return;
-
-	diff_db_delete(n->left);
-	diff_db_delete(n->right);
-	f = n->key.p;
-	free_diff(f);
-	free(n);
-}
-#endif
-
 /*******************************
  * Directory list DB *
  *******************************/
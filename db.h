@@ -3,9 +3,14 @@
 #endif
 
 enum sorting { DIRSFIRST, FILESFIRST, SORTMIXED, SORTMTIME, SORTSIZE };
+/* sorting and sortic */
+#define SORT_MODES (2 * (SORTSIZE + 1))
+#define SORT_MODE() ((int)sorting * 2 + (sortic ? 1 : 0))
+
+struct ddir_db;
 
 struct scan_db {
-	void *db;
+	struct ddir_db *db;
 	struct scan_db *next;
 };
 
@@ -25,9 +30,15 @@ int str_db_srch(void **, char *, char **);
 char **str_db_sort(void *, unsigned long);
 void diff_db_add(struct filediff *, int);
 void diff_db_sort(int);
+unsigned diff_db_part(int, int);
 void diff_db_restore(struct ui_state *);
 void diff_db_store(struct ui_state *);
 void diff_db_free(int);
+struct arena *diff_db_arena(int);
+void diff_db_mem(void);
+void diff_db_filt_reset(int);
+void diff_db_st_free(struct ui_state *);
+bool diff_db_pend(void);
 void free_strs(void **);
 void add_alias(char *, char *, tool_flags_t);
 void db_def_ext(char *, char *, tool_flags_t);
@@ -47,6 +58,9 @@ void *str_db_get_node(void *);
 void push_scan_db(bool);
 void pop_scan_db(void);
 void free_scan_db(bool);
+int ddir_add(dev_t, ino_t);
+int ddir_srch(dev_t, ino_t);
+void ddir_del(dev_t, ino_t);
 int db_dl_add(char *, char *, char *);
 void ddl_del(char **);
 void bdl_del(char **);
@@ -60,8 +74,7 @@ extern unsigned short bsizlen[2];
 extern unsigned short majorlen[2], minorlen[2];
 extern size_t usrlen[2], grplen[2];
 extern short noequal, real_diff;
-extern void *scan_db;
-extern void *name_db;
+extern struct ddir_db *scan_db;
 extern void *skipext_db;
 extern void *uz_path_db;
 extern bool sortic;
@@ -0,0 +1,537 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Persistent cache of file content digests.  A 128 bit digest of a file is
+ * stored together with the file identity (device, inode, size, mtime).
+ * If both files of a compare have a valid entry, the compare needs no
+ * file read at all.  The cache is kept in ~/.vddiffdgst, which is read on
+ * start and merged and written on exit.  The lock file approach of the
+ * info file is used.  The number of entries is limited, the least recently
+ * used entries are removed first.
+ *
+ * The digest is MurmurHash3 x64 128 (public domain, Austin Appleby).
+ * Lookups and inserts are thread-safe. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <regex.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "ui.h"
+#include "main.h"
+#include "info.h"
+#include "dgst.h"
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+#define C1 0x87c37b91114253d5ULL
+#define C2 0x4cf5ad432745937fULL
+/* Free hash table slot */
+#define DGST_NIL ((uint32_t)-1)
+
+struct dgst_ent {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t siz;
+	int64_t sec;
+	uint32_t nsec;
+	uint32_t use; /* LRU clock */
+	uint64_t h[2];
+};
+
+static void dgst_blk(struct dgst_st *, const unsigned char *);
+static uint64_t fmix64(uint64_t);
+static void dgst_id(struct dgst_ent *, struct stat *);
+static uint32_t *dgst_slot(uint64_t, uint64_t);
+static void dgst_ins(struct dgst_ent *);
+static void dgst_rehash(size_t);
+static void dgst_evict(size_t);
+static int dgst_read(void);
+static int dgst_ucmp(const void *, const void *);
+
+static const char dgst_magic[8] = "VDDGST1\n";
+static const char dgst_name[] = "." BIN "dgst.new";
+
+/* Maximum number of entries, 0: cache disabled (RC file option) */
+unsigned long dgst_max;
+static char *dgst_tpth; /* .vddiffdgst.new */
+static char *dgst_pth;
+static char *dgst_lpth;
+static struct dgst_ent *dgst_v;
+static size_t dgst_num, dgst_vsiz;
+/* Hash table of indices of dgst_v, size is a power of 2 */
+static uint32_t *dgst_tab;
+static size_t dgst_tsiz;
+static uint32_t dgst_clk;
+static bool dgst_dirty;
+static unsigned long dgst_hits, dgst_miss, dgst_nevict;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t dgst_mtx = PTHREAD_MUTEX_INITIALIZER;
+# define DGST_LOCK() pthread_mutex_lock(&dgst_mtx)
+# define DGST_UNLOCK() pthread_mutex_unlock(&dgst_mtx)
+#else
+# define DGST_LOCK()
+# define DGST_UNLOCK()
+#endif
+
+void
+dgst_init(struct dgst_st *s)
+{
+	memset(s, 0, sizeof(struct dgst_st));
+}
+
+void
+dgst_upd(struct dgst_st *s, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+	size_t l;
+
+	s->len += len;
+
+	if (s->tlen) {
+		l = 16 - s->tlen;
+
+		if (l > len) {
+			l = len;
+		}
+
+		memcpy(s->t + s->tlen, p, l);
+		s->tlen += l;
+		p += l;
+		len -= l;
+
+		if (s->tlen < 16) {
+			return;
+		}
+
+		dgst_blk(s, s->t);
+		s->tlen = 0;
+	}
+
+	for (; len >= 16; p += 16, len -= 16) {
+		dgst_blk(s, p);
+	}
+
+	memcpy(s->t, p, len);
+	s->tlen = len;
+}
+
+void
+dgst_fin(struct dgst_st *s, uint64_t *h)
+{
+	uint64_t k1 = 0, k2 = 0, h1 = s->h1, h2 = s->h2;
+	unsigned i;
+
+	for (i = s->tlen; i > 8; i--) {
+		k2 ^= (uint64_t)s->t[i - 1] << (8 * (i - 9));
+	}
+
+	for (; i; i--) {
+		k1 ^= (uint64_t)s->t[i - 1] << (8 * (i - 1));
+	}
+
+	if (s->tlen > 8) {
+		k2 *= C2;
+		k2 = ROTL64(k2, 33);
+		k2 *= C1;
+		h2 ^= k2;
+	}
+
+	if (s->tlen) {
+		k1 *= C1;
+		k1 = ROTL64(k1, 31);
+		k1 *= C2;
+		h1 ^= k1;
+	}
+
+	h1 ^= s->len;
+	h2 ^= s->len;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+	h[0] = h1;
+	h[1] = h2;
+}
+
+static void
+dgst_blk(struct dgst_st *s, const unsigned char *p)
+{
+	uint64_t k1, k2;
+
+	/* Host byte order, the cache file is not portable anyway */
+	memcpy(&k1, p, 8);
+	memcpy(&k2, p + 8, 8);
+	k1 *= C1;
+	k1 = ROTL64(k1, 31);
+	k1 *= C2;
+	s->h1 ^= k1;
+	s->h1 = ROTL64(s->h1, 27);
+	s->h1 += s->h2;
+	s->h1 = s->h1 * 5 + 0x52dce729;
+	k2 *= C2;
+	k2 = ROTL64(k2, 33);
+	k2 *= C1;
+	s->h2 ^= k2;
+	s->h2 = ROTL64(s->h2, 31);
+	s->h2 += s->h1;
+	s->h2 = s->h2 * 5 + 0x38495ab5;
+}
+
+static uint64_t
+fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+	return k;
+}
+
+/* 0: {h} is set to the digest of the file with stat data {st}.
+ * -1: Not in cache. */
+
+int
+dgst_get(struct stat *st, uint64_t *h)
+{
+	struct dgst_ent e;
+	struct dgst_ent *p;
+	uint32_t *t;
+	int r = -1;
+
+	dgst_id(&e, st);
+	DGST_LOCK();
+
+	if (!dgst_tab || *(t = dgst_slot(e.dev, e.ino)) == DGST_NIL) {
+		goto miss;
+	}
+
+	p = dgst_v + *t;
+
+	if (p->siz != e.siz || p->sec != e.sec || p->nsec != e.nsec) {
+		goto miss;
+	}
+
+	p->use = ++dgst_clk;
+	h[0] = p->h[0];
+	h[1] = p->h[1];
+	dgst_hits++;
+	r = 0;
+	goto unlock;
+
+miss:
+	dgst_miss++;
+unlock:
+	DGST_UNLOCK();
+	return r;
+}
+
+/* Saves digest {h} of the file with stat data {st} */
+
+void
+dgst_put(struct stat *st, uint64_t *h)
+{
+	struct dgst_ent e;
+
+	dgst_id(&e, st);
+	e.h[0] = h[0];
+	e.h[1] = h[1];
+	DGST_LOCK();
+	e.use = ++dgst_clk;
+	dgst_ins(&e);
+	dgst_dirty = TRUE;
+
+	/* Evict in batches to make eviction O(1) amortized */
+	if (dgst_num > dgst_max + dgst_max / 8) {
+		dgst_evict(dgst_max);
+	}
+
+	DGST_UNLOCK();
+}
+
+static void
+dgst_id(struct dgst_ent *e, struct stat *st)
+{
+	memset(e, 0, sizeof(struct dgst_ent));
+	e->dev = st->st_dev;
+	e->ino = st->st_ino;
+	e->siz = st->st_size;
+	e->sec = st->st_mtim.tv_sec;
+	e->nsec = st->st_mtim.tv_nsec;
+}
+
+/* Slot of (dev, ino) in the hash table, DGST_NIL if not found */
+
+static uint32_t *
+dgst_slot(uint64_t dev, uint64_t ino)
+{
+	size_t i, m = dgst_tsiz - 1;
+	struct dgst_ent *p;
+
+	i = fmix64(ino ^ (dev << 32 | dev >> 32)) & m;
+
+	while (dgst_tab[i] != DGST_NIL) {
+		p = dgst_v + dgst_tab[i];
+
+		if (p->ino == ino && p->dev == dev) {
+			break;
+		}
+
+		i = (i + 1) & m;
+	}
+
+	return dgst_tab + i;
+}
+
+/* Inserts or replaces the entry for {e}.  Locked by caller. */
+
+static void
+dgst_ins(struct dgst_ent *e)
+{
+	uint32_t *t;
+
+	if (2 * (dgst_num + 1) > dgst_tsiz) {
+		dgst_rehash(dgst_tsiz ? 2 * dgst_tsiz : 1024);
+	}
+
+	if (*(t = dgst_slot(e->dev, e->ino)) != DGST_NIL) {
+		dgst_v[*t] = *e;
+		return;
+	}
+
+	if (dgst_num == dgst_vsiz) {
+		dgst_vsiz = dgst_vsiz ? 2 * dgst_vsiz : 512;
+		dgst_v = realloc(dgst_v, dgst_vsiz * sizeof(struct dgst_ent));
+	}
+
+	*t = dgst_num;
+	dgst_v[dgst_num++] = *e;
+}
+
+static void
+dgst_rehash(size_t n)
+{
+	size_t i;
+
+	free(dgst_tab);
+	dgst_tsiz = n;
+	dgst_tab = malloc(n * sizeof(uint32_t));
+	memset(dgst_tab, 0xff, n * sizeof(uint32_t));
+
+	for (i = 0; i < dgst_num; i++) {
+		*dgst_slot(dgst_v[i].dev, dgst_v[i].ino) = i;
+	}
+}
+
+/* Keeps the {n} most recently used entries */
+
+static void
+dgst_evict(size_t n)
+{
+	if (dgst_num <= n) {
+		return;
+	}
+
+	qsort(dgst_v, dgst_num, sizeof(struct dgst_ent), dgst_ucmp);
+	dgst_nevict += dgst_num - n;
+	dgst_num = n;
+	dgst_rehash(dgst_tsiz);
+}
+
+/* Most recently used first */
+
+static int
+dgst_ucmp(const void *a, const void *b)
+{
+	const struct dgst_ent *x = a, *y = b;
+
+	return x->use > y->use ? -1 : x->use < y->use ? 1 : 0;
+}
+
+/* Reads the cache file after the entries in memory.  Entries for inodes
+ * which are already in memory are ignored.  Locked by caller.
+ * -1: Error, 0: OK */
+
+static int
+dgst_read(void)
+{
+	FILE *fh;
+	char m[sizeof dgst_magic];
+	struct dgst_ent e;
+	int rv = 0;
+
+	if (!(fh = fopen(dgst_pth, "r"))) {
+		if (errno == ENOENT) {
+			return 0;
+		}
+
+		printerr(strerror(errno), "fopen \"%s\"", dgst_pth);
+		return -1;
+	}
+
+	if (fread(m, sizeof m, 1, fh) != 1 ||
+	    memcmp(m, dgst_magic, sizeof m)) {
+		/* Other version or empty, is overwritten */
+		goto close;
+	}
+
+	if (2 * dgst_num + 1024 > dgst_tsiz) {
+		dgst_rehash(dgst_tsiz ? 2 * dgst_tsiz : 1024);
+	}
+
+	while (fread(&e, sizeof e, 1, fh) == 1) {
+		if (*dgst_slot(e.dev, e.ino) == DGST_NIL) {
+			dgst_ins(&e);
+		}
+
+		if (e.use > dgst_clk) {
+			dgst_clk = e.use;
+		}
+	}
+
+	if (ferror(fh)) {
+		printerr(strerror(errno), "fread \"%s\"", dgst_pth);
+		rv = -1;
+	}
+
+close:
+	fclose(fh);
+	return rv;
+}
+
+/* Reads the cache file on start */
+
+void
+dgst_load(void)
+{
+	int lh;
+
+	if (!dgst_max) {
+		return;
+	}
+
+	if (!dgst_tpth) {
+		size_t l;
+
+		if (!(dgst_tpth = add_home_pth(dgst_name))) {
+			dgst_max = 0;
+			return;
+		}
+
+		l = strlen(dgst_tpth); /* .vddiffdgst.new */
+		dgst_pth = strdup(dgst_tpth);
+		dgst_lpth = strdup(dgst_tpth);
+		dgst_lpth[--l] = 'k'; /* .vddiffdgst.lck */
+		dgst_lpth[--l] = 'c';
+		dgst_lpth[--l] = 'l';
+		dgst_pth[--l] = 0; /* .vddiffdgst */
+	}
+
+	if ((lh = create_flock(dgst_lpth)) == -1) {
+		return;
+	}
+
+	DGST_LOCK();
+	dgst_read();
+	dgst_evict(dgst_max);
+	DGST_UNLOCK();
+	remove_flock(lh);
+}
+
+/* Merges the cache file with the new entries and writes it */
+
+void
+dgst_save(void)
+{
+	FILE *fh;
+	int lh;
+
+	if (!dgst_max || !dgst_pth || !dgst_dirty) {
+		return;
+	}
+
+	if ((lh = create_flock(dgst_lpth)) == -1) {
+		return;
+	}
+
+	DGST_LOCK();
+
+	/* Entries which had been written by other instances */
+	if (dgst_read()) {
+		goto unlock;
+	}
+
+	dgst_evict(dgst_max);
+
+	if (!(fh = fopen(dgst_tpth, "w"))) {
+		printerr(strerror(errno), "fopen \"%s\"", dgst_tpth);
+		goto unlock;
+	}
+
+	if (fwrite(dgst_magic, sizeof dgst_magic, 1, fh) != 1 ||
+	    (dgst_num && fwrite(dgst_v, sizeof(struct dgst_ent), dgst_num,
+	    fh) != dgst_num)) {
+		printerr(strerror(errno), "fwrite \"%s\"", dgst_tpth);
+		fclose(fh);
+		unlink(dgst_tpth);
+		goto unlock;
+	}
+
+	if (fclose(fh) == EOF) {
+		printerr(strerror(errno), "fclose \"%s\"", dgst_tpth);
+		unlink(dgst_tpth);
+		goto unlock;
+	}
+
+	if (rename(dgst_tpth, dgst_pth) == -1) {
+		printerr(strerror(errno), "rename \"%s\", \"%s\"",
+		    dgst_tpth, dgst_pth);
+		goto unlock;
+	}
+
+	dgst_dirty = FALSE;
+unlock:
+	DGST_UNLOCK();
+	remove_flock(lh);
+}
+
+/* Shows the statistics in the status line */
+
+void
+dgst_stat(void)
+{
+	if (!dgst_max) {
+		printerr(NULL, "Digest cache is disabled");
+		return;
+	}
+
+	DGST_LOCK();
+	printerr(NULL, "Digest cache: %lu/%lu entries, %lu hits, "
+	    "%lu misses, %lu evicted", (unsigned long)dgst_num, dgst_max,
+	    dgst_hits, dgst_miss, dgst_nevict);
+	DGST_UNLOCK();
+}
@@ -0,0 +1,18 @@
+/* Streaming digest state */
+struct dgst_st {
+	uint64_t h1, h2;
+	uint64_t len;
+	unsigned char t[16]; /* incomplete block */
+	unsigned tlen;
+};
+
+extern unsigned long dgst_max;
+
+void dgst_init(struct dgst_st *);
+void dgst_upd(struct dgst_st *, const void *, size_t);
+void dgst_fin(struct dgst_st *, uint64_t *);
+int dgst_get(struct stat *, uint64_t *);
+void dgst_put(struct stat *, uint64_t *);
+void dgst_load(void);
+void dgst_save(void);
+void dgst_stat(void);
@@ -27,6 +27,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <time.h>
 #include <stdarg.h>
 #include <signal.h>
+#include <stdint.h>
 #include "compat.h"
 #include "main.h"
 #include "ui.h"
@@ -37,6 +38,16 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "ui2.h"
 #include "gq.h"
 #include "tc.h"
+#include "scan.h"
+#include "dnam.h"
+#include "stx.h"
+#include "uring.h"
+#include "dgst.h"
+#include "fcmp.h"
+#include "acmp.h"
+#include "arena.h"
+#include "lcache.h"
+#include "pfch.h"
 
 struct scan_dir {
 	char *s;
@@ -44,23 +55,72 @@ struct scan_dir {
 	struct scan_dir *next;
 };
 
-static struct filediff *alloc_diff(char *);
+/* Window of stat requests which are submitted together with io_uring.
+ * Slots per name: 0: left stat(), 1: left lstat(), 2: right stat(),
+ * 3: right lstat() */
+struct ubat {
+	struct ur_stat *v;
+	char *p; /* paths */
+	size_t psiz;
+	size_t b, e; /* window [b, e) of name indices */
+	struct pfch *pf; /* prefetched results */
+	int rp; /* right pass */
+};
+
+#define UBAT_NUM 64
+
+/* Incremental list: Minimum number of names, time in ms until the list
+ * is shown first and between two updates, names between two polls */
+#define INC_MIN   10000
+#define INC_FIRST 100
+#define INC_TMO   250
+#define INC_MASK  255
+
+#define STM_FL(m) (((m) & STX_OWNER ? 0 : FDFL_NOOWN) | \
+    ((m) & STX_MTIME ? 0 : FDFL_NOMTIM))
+
+static struct filediff *alloc_diff(char *, int);
+static struct arena *fd_arena(struct filediff *);
+static struct fdcold *fd_cold(struct filediff *);
+static void set_cold(struct filediff *, int, struct stat *, unsigned,
+    off_t);
 static void add_diff_dir(short);
-static char *read_link(char *, off_t);
+static char *read_link(char *, off_t, struct arena *);
 static size_t pthadd(char *, size_t, const char *);
 static size_t pthcut(char *, size_t);
-static void ini_int(void);
+static int name_rt(struct dnam *, size_t, int, int);
+static void ubat_fill(struct ubat *, struct dnam *, size_t *, size_t, int,
+    int, int, unsigned *);
+static int ubat_stat(struct ubat *, size_t, int, const char *,
+    struct stat *, unsigned);
+static void inc_ini(size_t);
+static void inc_poll(void);
+static void inc_end(void);
+static long inc_ms(void);
 
 static struct filediff *diff;
 static off_t lsiz1, lsiz2;
 static char *last_path;
+/* Compare buffers of cmp_file() */
+static struct fcmp cmp_ctx;
 
 short followlinks;
+/* Read directories in inode order */
+short ino_order;
+/* Offset of the first difference found by cmp_file() */
+off_t cmp_off;
 
 bool one_scan;
 bool dotdot;
 static bool stopscan;
-static bool ign_diff_errs;
+bool ign_diff_errs;
+/* Show huge directories while they are read */
+bool inc_list;
+/* Names of the directory, list is polled, list had been displayed */
+static size_t inc_tot;
+static unsigned inc_num;
+static bool inc_on, inc_shown;
+static long inc_t0, inc_last;
 
 /* !0: Error */
 int
@@ -70,16 +130,34 @@ build_diff_db(
      * 3: Proc both dirs */
     int tree)
 {
-	DIR *d;
-	struct dirent *ent;
+	struct dnam ln, rn;
+	/* {nj} is the index of the {ni}th name in inode order */
+	size_t ni, nj, *no = NULL;
+	/* d_type of right name, -1: Does not exist */
+	int rt;
+	mode_t m[2];
+	/* statx() mask */
+	unsigned stm[2];
 	char *name;
 	struct scan_dir *dirs = NULL;
 	int retval = 0;
+	/* 0: OK, -1: opendir failed, -2: readdir failed */
+	int lerr = 0, rerr = 0;
+	int lerrno = 0, rerrno = 0;
+	/* Right directory had been read before the left one */
+	bool rread = FALSE;
+	/* All names of the right directory are known, a failing stat() for
+	 * left-only names can be avoided. */
+	bool rknown = FALSE;
 	/* Used to show only dirs which contains diffs. Is set if any diff
 	 * is found inside a dir. */
 	short dir_diff = 0;
 	bool file_err = FALSE;
 	static time_t lpt, lpt2;
+	struct ubat ub;
+	struct pfch *pf = NULL;
+	/* Files of this directory for the content search */
+	size_t gm;
 
 	if ((bmode || fmode) && !file_pattern) {
 		if (scan) {
@@ -93,6 +171,12 @@ build_diff_db(
 	fprintf(debug, "->build_diff_db tree(%d)%s\n",
 	    tree, scan ? " scan" : "");
 #endif
+	memset(&ln, 0, sizeof ln);
+	memset(&rn, 0, sizeof rn);
+	memset(&ub, 0, sizeof ub);
+	stm[0] = stm[1] = scan || qdiff ? 0 : diff_stmask();
+	gm = gq_mark();
+
 	if (one_scan) {
 		one_scan = FALSE;
 
@@ -101,6 +185,12 @@ build_diff_db(
 		}
 	}
 
+	if (!scan && !qdiff && !bmode && !fmode) {
+		ub.pf = pf = pf_take(tree, stm[0]);
+	}
+
+	inc_on = inc_shown = FALSE;
+
 	if (!(tree & 1)) {
 		goto right_tree;
 	}
@@ -136,7 +226,8 @@ build_diff_db(
 #if defined(TRACE) && 1
 	fprintf(debug, "  opendir lp(%s)%s\n", syspth[0], scan ? " scan" : "");
 #endif
-	if (!(d = opendir(syspth[0]))) {
+	if ((lerr = pf_read(pf, 0, &ln, syspth[0],
+	    (bmode || fmode) && dotdot)) == -1) {
 		if (!ign_diff_errs && dialog(ign_txt, NULL,
 		    "opendir \"%s\": %s", syspth[0],
 		    strerror(errno)) == 'i')
@@ -146,52 +237,98 @@ build_diff_db(
 		goto dir_scan_end;
 	}
 
-	while (1) {
-		int i;
+	lerrno = errno;
+	stm[0] |= stx_dirfl(syspth[0]);
 
-		errno = 0;
+	/* Both directories are paired by a merge of the sorted name
+	 * vectors. Only names which exist on the right side are stat'ed
+	 * there. */
+	if ((tree & 2) && !(bmode || fmode)) {
+		rread = TRUE;
 
-		if (!(ent = readdir(d))) {
-			if (!errno)
-				break;
+		if ((rerr = pf_read(pf, 1, &rn, syspth[1], 0))) {
+			rerrno = errno;
+		}
+
+		stm[1] |= stx_dirfl(syspth[1]);
 
-			syspth[0][pthlen[0]] = 0;
-			printerr(strerror(errno), "readdir \"%s\"", syspth[0]);
-			closedir(d);
-			retval = -1;
-			goto dir_scan_end;
+		if (rerr != -1) {
+			dnam_pair(&ln, &rn);
 		}
 
-#if defined(TRACE) && 1
-		fprintf(debug, "  readdir L \"%s\"\n", ent->d_name);
-#endif
-		name = ent->d_name;
+		if (!rerr) {
+			rknown = TRUE;
+		}
+	}
 
-		if (*name == '.' && (!name[1] ||
-		    (!((bmode || fmode) && dotdot) &&
-		     name[1] == '.' && !name[2]))) {
-			continue;
+	if (tree & 2) {
+		size_t n = ln.num;
+
+		for (ni = 0; ni < rn.num; ni++) {
+			if (!rn.pr[ni]) {
+				n++;
+			}
 		}
 
-		if (!(bmode || fmode)) {
-			str_db_add(&name_db, strdup(name)
-#ifdef HAVE_LIBAVLBST
-			    , 0, NULL
-#endif
-			    );
+		inc_ini(n);
+	} else {
+		inc_ini(ln.num);
+	}
+
+	/* In inode order the names can be stat'ed with less disk seeks.
+	 * The list is sorted later anyway. */
+	if (ino_order && !qdiff && !pf) {
+		no = dnam_inoord(&ln);
+	}
+
+	for (ni = 0; ni < ln.num; ni++) {
+		int i;
+
+		if (ni == ub.e && use_uring && !pf) {
+			ubat_fill(&ub, &ln, no, ni, tree, rknown, 0, stm);
+		}
+
+		if (inc_on && !(ni & INC_MASK)) {
+			inc_poll();
 		}
 
+		nj = no ? no[ni] : ni;
+		name = ln.v[nj];
 		pthadd(syspth[0], pthlen[0], name);
 #if defined(TRACE) && 1
 		fprintf(debug,
 		    "  found L \"%s\" \"%s\" strlen=%zu pthlen=%zu\n",
-		    ent->d_name, syspth[0], strlen(syspth[0]), pthlen[0]);
+		    name, syspth[0], strlen(syspth[0]), pthlen[0]);
 #endif
 
+		rt = name_rt(&ln, nj, tree, rknown);
+
+		/* The scan only needs the file type for most names. It is
+		 * taken from d_type then. */
+		if ((scan || qdiff) && !gq_pattern && dnam_notstat(
+		    DNAM_TYP(name), rt, followlinks, find_name, m)) {
+			gstat[0].st_mode = m[0];
+			gstat[1].st_mode = m[1];
+
+			if (tree & 2) {
+				pthcat(syspth[1], pthlen[1], name);
+			}
+
+			if (qdiff && !m[1]) {
+				syspth[0][pthlen[0]] = 0;
+				printf("Only in %s: %s\n", syspth[0],
+				    name);
+				continue;
+			}
+
+			goto scan_ent;
+		}
+
 		/* Get link length. Redundant code but necessary,
 		 * unfortunately. */
 
-		if (followlinks && !scan && lstat(syspth[0], &gstat[0]) != -1 &&
+		if (followlinks && !scan && DNAM_MAYLNK(DNAM_TYP(name)) &&
+		    ubat_stat(&ub, ni, 1, syspth[0], &gstat[0], stm[0]) != -1 &&
 		    S_ISLNK(gstat[0].st_mode))
 			lsiz1 = gstat[0].st_size;
 		else
@@ -199,8 +336,10 @@ build_diff_db(
 
 		file_err = FALSE;
 
-		if (!followlinks || (i = stat(syspth[0], &gstat[0])) == -1)
-			i = lstat(syspth[0], &gstat[0]);
+		if (!followlinks ||
+		    (i = ubat_stat(&ub, ni, 0, syspth[0], &gstat[0], stm[0]))
+		    == -1)
+			i = ubat_stat(&ub, ni, 1, syspth[0], &gstat[0], stm[0]);
 
 		if (i == -1) {
 			if (errno != ENOENT) {
@@ -226,15 +365,24 @@ build_diff_db(
 			goto no_tree2;
 		}
 
-		if (followlinks && !scan && lstat(syspth[1], &gstat[1]) != -1 &&
+		if (rknown && !ln.pr[nj]) {
+			/* Left-only, no stat() necessary */
+			lsiz2 = -1;
+			goto no_tree2;
+		}
+
+		if (followlinks && !scan && DNAM_MAYLNK(rt) &&
+		    ubat_stat(&ub, ni, 3, syspth[1], &gstat[1], stm[1]) != -1 &&
 		    S_ISLNK(gstat[1].st_mode)) {
 			lsiz2 = gstat[1].st_size;
 		} else {
 			lsiz2 = -1;
 		}
 
-		if (!followlinks || (i = stat(syspth[1], &gstat[1])) == -1)
-			i = lstat(syspth[1], &gstat[1]);
+		if (!followlinks ||
+		    (i = ubat_stat(&ub, ni, 2, syspth[1], &gstat[1], stm[1]))
+		    == -1)
+			i = ubat_stat(&ub, ni, 3, syspth[1], &gstat[1], stm[1]);
 
 		if (i == -1) {
 			if (errno != ENOENT) {
@@ -262,11 +410,11 @@ no_tree2:
 			gstat[1].st_mode = 0;
 		}
 
+scan_ent:
 		if (scan || qdiff) {
 			if (stopscan ||
 			    ((bmode || fmode) && file_pattern && getch() == '%')) {
 				stopscan = TRUE;
-				closedir(d);
 				goto dir_scan_end;
 			}
 
@@ -289,7 +437,7 @@ no_tree2:
 			}
 
 			if (find_name) {
-				if (regexec(&fn_re, name, 0, NULL, 0)) {
+				if (fn_match(name)) {
 					continue;
 				} else if (!gq_pattern) {
 					dir_diff = 1;
@@ -298,15 +446,13 @@ no_tree2:
 			}
 
 			if (gq_pattern) {
-				diff = alloc_diff(name);
+				diff = alloc_diff(name, -1);
 				diff->type[0] = gstat[0].st_mode;
 				diff->type[1] = gstat[1].st_mode;
 				diff->siz[0]  = gstat[0].st_size;
 				diff->siz[1]  = gstat[1].st_size;
-
-				if (!gq_proc(diff))
-					dir_diff = 1;
-
+				/* Result is taken by gq_wait() */
+				gq_add(diff, NULL);
 				free_diff(diff);
 				continue;
 			}
@@ -330,10 +476,12 @@ no_tree2:
 			    S_ISLNK(gstat[1].st_mode)) {
 				char *a, *b;
 
-				if (!(a = read_link(syspth[0], gstat[0].st_size)))
+				if (!(a = read_link(syspth[0], gstat[0].st_size,
+				    NULL)))
 					continue;
 
-				if (!(b = read_link(syspth[1], gstat[1].st_size)))
+				if (!(b = read_link(syspth[1], gstat[1].st_size,
+				    NULL)))
 					goto free_a;
 
 				if (strcmp(a, b)) {
@@ -369,7 +517,8 @@ free_a:
 			continue;
 		}
 
-		diff = alloc_diff(name);
+		diff = alloc_diff(name, 0);
+		diff->fl |= STM_FL(stm[0]);
 
 		if (file_err) {
 			diff->diff = '-';
@@ -382,17 +531,16 @@ free_a:
 			fprintf(debug, "  found L 0%o \"%s\"\n",
 			    gstat[0].st_mode, syspth[0]);
 #endif
-			diff->uid[0] = gstat[0].st_uid;
-			diff->gid[0] = gstat[0].st_gid;
 			diff->siz[0] = gstat[0].st_size;
-			diff->mtim[0] = gstat[0].st_mtim.tv_sec;
-			diff->rdev[0] = gstat[0].st_rdev;
 
 			if (S_ISLNK(gstat[0].st_mode))
 				lsiz1 = gstat[0].st_size;
 
+			set_cold(diff, 0, &gstat[0], stm[0], lsiz1);
+
 			if (lsiz1 >= 0)
-				diff->llink = read_link(syspth[0], lsiz1);
+				diff->cold->llink = read_link(syspth[0], lsiz1,
+				    diff_db_arena(0));
 		}
 
 		if ((diff->type[1] = gstat[1].st_mode)) {
@@ -400,17 +548,21 @@ free_a:
 			fprintf(debug, "  found R 0%o \"%s\"\n",
 			    gstat[1].st_mode, syspth[1]);
 #endif
-			diff->uid[1] = gstat[1].st_uid;
-			diff->gid[1] = gstat[1].st_gid;
 			diff->siz[1] = gstat[1].st_size;
-			diff->mtim[1] = gstat[1].st_mtim.tv_sec;
-			diff->rdev[1] = gstat[1].st_rdev;
 
 			if (S_ISLNK(gstat[1].st_mode))
 				lsiz2 = gstat[1].st_size;
 
-			if (lsiz2 >= 0)
-				diff->rlink = read_link(syspth[1], lsiz2);
+			set_cold(diff, 1, &gstat[1], stm[1], lsiz2);
+
+			if (lsiz2 >= 0 && (diff->cold->rlink =
+			    read_link(syspth[1], lsiz2, diff_db_arena(0))) &&
+			    diff->cold->llink &&
+			    !strcmp(diff->cold->llink, diff->cold->rlink)) {
+				/* Same link target is stored once */
+				arena_rel(diff_db_arena(0), diff->cold->rlink);
+				diff->cold->rlink = diff->cold->llink;
+			}
 		}
 
 		if ((diff->type[0] & S_IFMT) != (diff->type[1] & S_IFMT)) {
@@ -427,6 +579,16 @@ free_a:
 
 		} else if (S_ISREG(gstat[0].st_mode)) {
 
+			/* Compared in the background, list is shown
+			 * immediately */
+			if (!bmode && !fmode && !dontcmp &&
+			    gstat[0].st_size == gstat[1].st_size &&
+			    gstat[0].st_size && acmp_init()) {
+				diff->diff = '?';
+				acmp_add(diff, syspth[0], syspth[1]);
+				goto db_add_file;
+			}
+
 			switch (cmp_file(syspth[0], gstat[0].st_size, syspth[1],
 			    gstat[1].st_size, 0)) {
 			case -1:
@@ -448,8 +610,9 @@ db_add_file:
 
 		} else if (S_ISLNK(gstat[0].st_mode)) {
 
-			if (diff->llink && diff->rlink) {
-				if (strcmp(diff->llink, diff->rlink))
+			if (FD_LLINK(diff) && FD_RLINK(diff)) {
+				if (strcmp(diff->cold->llink,
+				    diff->cold->rlink))
 					diff->diff = '!';
 				diff_db_add(diff, 0);
 				continue;
@@ -461,12 +624,21 @@ db_add_file:
 			continue;
 		}
 
-		free(diff);
+		free_diff(diff);
 	}
 
-	closedir(d);
 	syspth[0][pthlen[0]] = 0;
 
+	if (gq_pattern && !gq_wait(gm, NULL)) {
+		dir_diff = 1;
+	}
+
+	if (lerr) {
+		printerr(strerror(lerrno), "readdir \"%s\"", syspth[0]);
+		retval = -1;
+		goto dir_scan_end;
+	}
+
 	/* Now already done here for diff mode to use syspth[0] instead of syspth[1].
 	 * May be useless. */
 	if (scan && dir_diff && !qdiff) {
@@ -500,44 +672,54 @@ right_tree:
 #if defined(TRACE) && 0
 	fprintf(debug, "  opendir rp(%s)%s\n", syspth[1], scan ? " scan" : "");
 #endif
-	if (!(d = opendir(syspth[1]))) {
+	if (!rread) {
+		if ((rerr = pf_read(pf, 1, &rn, syspth[1],
+		    (bmode || fmode) && dotdot))) {
+			rerrno = errno;
+		}
+
+		stm[1] |= stx_dirfl(syspth[1]);
+	}
+
+	if (rerr == -1) {
 		if (!ign_diff_errs && dialog(ign_txt, NULL,
 		    "opendir \"%s\" failed: %s", syspth[1],
-		    strerror(errno)) == 'i')
+		    strerror(rerrno)) == 'i')
 			ign_diff_errs = TRUE;
 
 		retval = -1;
 		goto dir_scan_end;
 	}
 
-	while (1) {
-		int i;
+	ub.b = ub.e = 0;
+	ub.rp = 1;
+	free(no);
+	no = NULL;
 
-		errno = 0;
+	if (ino_order && !qdiff && !pf) {
+		no = dnam_inoord(&rn);
+	}
 
-		if (!(ent = readdir(d))) {
-			if (!errno)
-				break;
-			printerr(strerror(errno), "readdir \"%s\" failed",
-			    syspth[1]);
-			closedir(d);
-			retval = -1;
-			goto dir_scan_end;
-		}
+	if (!(tree & 1)) {
+		inc_ini(rn.num);
+	}
 
-#if defined(TRACE) && 1
-		fprintf(debug, "  readdir R \"%s\"\n", ent->d_name);
-#endif
-		name = ent->d_name;
+	for (ni = 0; ni < rn.num; ni++) {
+		int i;
 
-		if (*name == '.' && (!name[1] ||
-		    (!((bmode || fmode) && dotdot) &&
-		     name[1] == '.' && !name[2]))) {
-			continue;
+		if (ni == ub.e && use_uring && !pf) {
+			ubat_fill(&ub, &rn, no, ni, tree, rknown, 1, stm);
+		}
+
+		if (inc_on && !(ni & INC_MASK)) {
+			inc_poll();
 		}
 
-		if (!(bmode || fmode) && (tree & 1) && !str_db_srch(&name_db,
-		    name, NULL)) {
+		nj = no ? no[ni] : ni;
+		name = rn.v[nj];
+
+		/* Already processed in left pass */
+		if (rn.pr[nj]) {
 			continue;
 		}
 
@@ -554,20 +736,29 @@ right_tree:
 #if defined(TRACE) && 1
 		fprintf(debug,
 		    "  found R \"%s\" \"%s\" strlen=%zu pthlen=%zu\n",
-		    ent->d_name, syspth[1], strlen(syspth[1]), pthlen[1]);
+		    name, syspth[1], strlen(syspth[1]), pthlen[1]);
 #endif
+		file_err = FALSE;
 
-		if (followlinks && !scan && lstat(syspth[1], &gstat[1]) != -1 &&
+		if (scan && !gq_pattern && dnam_notstat(DNAM_TYP(name), -1,
+		    followlinks, find_name, m)) {
+			gstat[1].st_mode = m[0];
+			goto scan_rent;
+		}
+
+		if (followlinks && !scan && DNAM_MAYLNK(DNAM_TYP(name)) &&
+		    ubat_stat(&ub, ni, 3, syspth[1], &gstat[1], stm[1]) != -1 &&
 		    S_ISLNK(gstat[1].st_mode)) {
 			lsiz2 = gstat[1].st_size;
 		} else {
 			lsiz2 = -1;
 		}
 
-		file_err = FALSE;
-
-		if (!followlinks || (i = stat(syspth[1], &gstat[1])) == -1) {
-			i = lstat(syspth[1], &gstat[1]);
+		if (!followlinks ||
+		    (i = ubat_stat(&ub, ni, 2, syspth[1], &gstat[1], stm[1]))
+		    == -1) {
+			i = ubat_stat(&ub, ni, 3, syspth[1], &gstat[1],
+			    stm[1]);
 		}
 
 		if (i == -1) {
@@ -585,11 +776,11 @@ right_tree:
 			gstat[1].st_mode = 0;
 		}
 
+scan_rent:
 		if (scan) {
 			if (stopscan ||
 			    ((bmode || fmode) && file_pattern && getch() == '%')) {
 				stopscan = TRUE;
-				closedir(d);
 				goto dir_scan_end;
 			}
 
@@ -605,7 +796,7 @@ right_tree:
 			}
 
 			if (find_name) {
-				if (regexec(&fn_re, name, 0, NULL, 0)) {
+				if (fn_match(name)) {
 					/* No match */
 					continue;
 				} else if (
@@ -617,7 +808,8 @@ right_tree:
 			}
 		}
 
-		diff = alloc_diff(name);
+		diff = alloc_diff(name, scan ? -1 : fmode ? 1 : 0);
+		diff->fl |= STM_FL(stm[1]);
 		diff->type[0] = 0;
 		diff->type[1] = gstat[1].st_mode;
 
@@ -628,22 +820,21 @@ right_tree:
 			fprintf(debug, "  found R 0%o \"%s\"\n",
 			    gstat[1].st_mode, syspth[1]);
 #endif
-			diff->uid[1] = gstat[1].st_uid;
-			diff->gid[1] = gstat[1].st_gid;
 			diff->siz[1] = gstat[1].st_size;
-			diff->mtim[1] = gstat[1].st_mtim.tv_sec;
-			diff->rdev[1] = gstat[1].st_rdev;
 
 			if (S_ISLNK(gstat[1].st_mode))
 				lsiz2 = gstat[1].st_size;
 
+			set_cold(diff, 1, &gstat[1], stm[1], lsiz2);
+
 			if (lsiz2 >= 0)
-				diff->rlink = read_link(syspth[1], lsiz2);
+				diff->cold->rlink = read_link(syspth[1], lsiz2,
+				    fd_arena(diff));
 		}
 
 		if (scan) {
-			if (gq_pattern && !gq_proc(diff)) {
-				dir_diff = 1;
+			if (gq_pattern) {
+				gq_add(diff, NULL);
 			}
 
 			free_diff(diff);
@@ -653,16 +844,37 @@ right_tree:
 		diff_db_add(diff, fmode ? 1 : 0);
 	}
 
-	closedir(d);
+	/* Not reached after a break */
+	if (rerr && ni == rn.num) {
+		syspth[1][pthlen[1]] = 0;
+		printerr(strerror(rerrno), "readdir \"%s\" failed",
+		    syspth[1]);
+		retval = -1;
+		goto dir_scan_end;
+	}
 
 build_list:
-	if (!scan)
+	if (!scan && !inc_shown)
 		diff_db_sort(fmode && (tree & 2) ? 1 : 0);
 
 dir_scan_end:
-	free_strs(&name_db);
+	if (inc_shown) {
+		inc_end();
+	}
+
+	if (gq_pattern && !gq_wait(gm, NULL)) {
+		dir_diff = 1;
+	}
+
+	dnam_free(&ln);
+	dnam_free(&rn);
+	free(ub.v);
+	free(ub.p);
+	free(no);
+	pf_free(pf);
 
 	if (!scan) {
+		acmp_start();
 		goto exit;
 	}
 
@@ -696,7 +908,149 @@ exit:
 	return retval;
 }
 
+/* d_type of the right name for left name {ni}, -1 if it does not exist */
+
+static int
+name_rt(struct dnam *ln, size_t ni, int tree, int rknown)
+{
+	if (!(tree & 2) || (rknown && !ln->pr[ni])) {
+		return -1;
+	} else if (ln->pr[ni]) {
+		return DNAM_PRTYP(ln->pr[ni]);
+	} else {
+		return 0; /* DT_UNKNOWN */
+	}
+}
+
+/* Gets the attributes of the next UBAT_NUM names of {d} (starting at {ni})
+ * with io_uring.  Exactly the stat() calls which build_diff_db() would do
+ * are requested.  Additional calls (e.g. lstat() after a failing stat())
+ * are done synchronously by ubat_stat().  {no}: Order of the names, NULL
+ * for name order.  {rp}: Right pass */
+
 static void
+ubat_fill(struct ubat *u, struct dnam *d, size_t *no, size_t ni, int tree,
+    int rknown, int rp, unsigned *stm)
+{
+	size_t i, j, k, l, n = 0, o = 0;
+	int lt, rt, s[2];
+	mode_t m[2];
+	char *p;
+
+	u->b = u->e = ni;
+
+	if (rp && (qdiff || (scan && !file_pattern))) {
+		return;
+	}
+
+	/* A name has at most 255 bytes */
+	l = UBAT_NUM * 2 * ((pthlen[0] > pthlen[1] ? pthlen[0] : pthlen[1]) +
+	    258);
+
+	if (!u->v) {
+		u->v = malloc(UBAT_NUM * 4 * sizeof(struct ur_stat));
+	}
+
+	if (l > u->psiz) {
+		free(u->p);
+		u->p = malloc(u->psiz = l);
+	}
+
+	memset(u->v, 0, UBAT_NUM * 4 * sizeof(struct ur_stat));
+
+	for (i = 0; i < UBAT_NUM && ni + i < d->num; i++) {
+		k = no ? no[ni + i] : ni + i;
+		lt = DNAM_TYP(d->v[k]);
+
+		if (rp) {
+			if (d->pr[k] || (scan && !gq_pattern &&
+			    dnam_notstat(lt, -1, followlinks, find_name, m))) {
+				continue;
+			}
+
+			s[0] = -1;
+			s[1] = lt;
+		} else {
+			rt = name_rt(d, k, tree, rknown);
+
+			if ((scan || qdiff) && !gq_pattern &&
+			    dnam_notstat(lt, rt, followlinks, find_name, m)) {
+				continue;
+			}
+
+			s[0] = lt;
+			s[1] = rt;
+		}
+
+		for (j = 0; j < 2; j++) {
+			struct ur_stat *v = &u->v[i * 4 + j * 2];
+
+			if (s[j] < 0 || (l = strlen(d->v[k])) > 255 ||
+			    pthlen[j] + l + 2 > PATHSIZ) {
+				continue;
+			}
+
+			/* Same as pthadd() */
+			p = u->p + o;
+			memcpy(p, syspth[j], pthlen[j]);
+			o += pthlen[j];
+
+			if (pthlen[j] && p[pthlen[j] - 1] != '/') {
+				u->p[o++] = '/';
+			}
+
+			memcpy(u->p + o, d->v[k], l + 1);
+			o += l + 1;
+
+			if (followlinks) {
+				v[0].pth = p;
+				v[0].msk = stm[j];
+				n++;
+			}
+
+			if (!followlinks || (!scan && DNAM_MAYLNK(s[j]))) {
+				v[1].pth = p;
+				v[1].msk = stm[j];
+				v[1].nofollow = 1;
+				n++;
+			}
+		}
+	}
+
+	if (!n || !ur_statv(u->v, i * 4)) {
+		u->e = ni + i;
+	}
+}
+
+/* stat() (even {slot}) or lstat() (odd {slot}) of name {ni}.  The result
+ * is taken from the prefetch or the io_uring window if available. */
+
+static int
+ubat_stat(struct ubat *u, size_t ni, int slot, const char *pth,
+    struct stat *st, unsigned m)
+{
+	struct ur_stat *v;
+	int r;
+
+	if (u->pf && (r = pf_stat(u->pf, u->rp, ni, slot, st)) != 1) {
+		return r;
+	}
+
+	if (ni >= u->b && ni < u->e &&
+	    (v = &u->v[(ni - u->b) * 4 + slot])->pth) {
+		if (v->err) {
+			errno = v->err;
+			return -1;
+		}
+
+		*st = v->st;
+		return 0;
+	}
+
+	return slot & 1 ? stx_lstat(pth, st, m) : stx_stat(pth, st, m);
+}
+
+void
 ini_int(void)
 {
 	const char *s = "Type '%' to disable file compare";
@@ -718,6 +1072,115 @@ ini_int(void)
 	wrefresh(wstat);
 }
 
+/* Incremental list (option "incremental"):  In diff mode a directory
+ * with at least INC_MIN names is displayed in read order when it had been
+ * read for INC_FIRST ms.  The list is updated while the names are stat'ed
+ * and compared and is sorted at the end.  Until then the cursor can be
+ * moved and the list can be searched.  Any other key ends the polling and
+ * is processed with the complete list. */
+
+static void
+inc_ini(size_t n)
+{
+	inc_tot = n;
+	inc_on = inc_list && !scan && !qdiff && !bmode && !fmode &&
+	    n >= INC_MIN;
+	inc_last = inc_t0 = inc_on ? inc_ms() : 0;
+}
+
+static void
+inc_poll(void)
+{
+	long t;
+	int c;
+	bool k = FALSE;
+
+	t = inc_ms();
+
+	if (!inc_shown) {
+		if (t - inc_t0 < INC_FIRST) {
+			return;
+		}
+
+		inc_num = diff_db_part(0, 1);
+		inc_shown = TRUE;
+		disp_list(1);
+		goto prog;
+	}
+
+	while ((c = getch()) != ERR) {
+		if (c == '%') {
+			dontcmp = TRUE;
+			continue;
+		}
+
+		if (!k) {
+			inc_num = diff_db_part(0, 0);
+			k = TRUE;
+		}
+
+		if (!ui_inc_key(c)) {
+			keep_ungetch(c);
+			inc_on = FALSE;
+			break;
+		}
+	}
+
+	if (t - inc_last < INC_TMO) {
+		if (k) {
+			goto prog;
+		}
+
+		return;
+	}
+
+	if (!k) {
+		inc_num = diff_db_part(0, 0);
+	}
+
+	disp_list(1);
+prog:
+	inc_last = t;
+	printerr(NULL,
+	    "%u of %zu entries read, type '%%' to disable file compare",
+	    inc_num, inc_tot);
+}
+
+/* Sorts the list which had been displayed by inc_poll() */
+
+static void
+inc_end(void)
+{
+	struct filediff *f;
+	unsigned i;
+
+	inc_on = inc_shown = FALSE;
+	/* Keep the cursor on the same entry */
+	f = db_num[0] ? db_list[0][top_idx[0] + curs[0]] : NULL;
+	diff_db_sort(0);
+
+	for (i = 0; f && i < db_num[0] && db_list[0][i] != f; i++);
+
+	if (f && i < db_num[0]) {
+		if (curs[0] > i) {
+			curs[0] = i;
+		}
+
+		top_idx[0] = i - curs[0];
+	}
+
+	printerr(NULL, NULL);
+}
+
+static long
+inc_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 int
 scan_subdir(char *name, char *rnam, int tree)
 {
@@ -747,7 +1210,11 @@ scan_subdir(char *name, char *rnam, int tree)
 		}
 	}
 
-	i = build_diff_db(tree);
+	if ((tree & SCAN_LC) && lc_load(tree & 3)) {
+		i = 0;
+	} else if ((i = build_diff_db(tree & 3))) {
+		lc_drop();
+	}
 #if defined(TRACE)
 	fprintf(debug, "<-scan_subdir: %d\n", i);
 #endif
@@ -812,7 +1279,7 @@ add_diff_dir(
     /* Only fmode: 0: syspth[0], 1: syspth[1] */
     short side)
 {
-	char *path, *end, *rp = NULL;
+	char *path;
 
 	/* During scan bmode uses syspth[0] */
 	syspth[0][pthlen[0]] = 0;
@@ -822,67 +1289,56 @@ add_diff_dir(
 	fprintf(debug, "->add_diff_dir(%s:%s) lp(%s) rp(%s)\n",
 	    side ? "right" : "left", path, syspth[0], syspth[1]);
 #endif
+	add_diff_pth(path);
+}
 
-	if (!(rp = realpath(path, NULL))) {
-		printerr(strerror(errno), LOCFMT "realpath \"%s\""
-		    LOCVAR, path);
-		goto ret0;
-	}
-
-	path = rp;
-	end = path + strlen(path);
+/* Add directory {path} and all its parent directories to the scan DB.
+ * The parents are found with "..", so they are the same as the ones of
+ * realpath({path}). */
 
-	while (1) {
-#ifdef HAVE_LIBAVLBST
-		struct bst_node *n;
-		int i;
-
-		if (!(i = str_db_srch(&scan_db, path, &n)))
-			goto ret;
+void
+add_diff_pth(const char *path)
+{
+	char pth[PATHSIZ];
+	struct stat st;
+	size_t l;
 
-		str_db_add(&scan_db, strdup(path), i, n);
-#else
-		char *s, *s2;
+	if ((l = strlen(path)) >= sizeof pth) {
+		return;
+	}
 
-		s = strdup(path);
-		s2 = str_db_add(&scan_db, s);
+	memcpy(pth, path, l + 1);
 
-		if (s2 != s) {
-			free(s);
-			goto ret;
+	/* Stops at the root directory, which is its own parent */
+	while (1) {
+		if (stat(pth, &st) == -1) {
+			printerr(strerror(errno), LOCFMT "stat \"%s\""
+			    LOCVAR, pth);
+			return;
 		}
-#endif
 
+		if (!ddir_add(st.st_dev, st.st_ino)) {
+			/* Parents are already there */
+			return;
+		}
 #if defined(TRACE) && 0
-		fprintf(debug, "  \"%s\" added\n", path);
+		fprintf(debug, "  \"%s\" added\n", pth);
 #endif
-		do {
-			if (--end < path)
-				goto ret;
-		} while (*end != '/');
-
-		if (end == path) {
-			end[1] = 0;
-		} else {
-			*end = 0;
+		if (l + 4 > sizeof pth) {
+			return;
 		}
-	}
 
-ret:
-	free(rp);
-ret0:
-#if defined(TRACE) && 0
-	fprintf(debug, "<-add_diff_dir\n");
-#endif
-	return;
+		memcpy(pth + l, "/..", 4);
+		l += 3;
+	}
 }
 
+/* Only uses the data of the list entry, no system call */
+
 int
 is_diff_dir(struct filediff *f)
 {
-	char *bp = NULL, *pth;
-	size_t l;
-	int v = 0;
+	int i, v = 0;
 
 	/* E.g. for file stat called independend from 'recursive' */
 	/* or called in bmode with option -r (for later dir diffs) */
@@ -892,33 +1348,11 @@ is_diff_dir(struct filediff *f)
 #if defined(TRACE) && 0
 	fprintf(debug, "->is_diff_dir(%s)\n", f->name);
 #endif
-	if (bmode) {
-		pth = syspth[1];
-		l = strlen(pth);
-		bp = malloc(l + strlen(f->name) + 2);
-		memcpy(bp, pth, l);
-		pth = bp;
-		pthcat(pth, l, f->name);
-		v = is_diff_pth(pth, 0);
-		free(bp);
-	} else {
-		if (f->type[0]) {
-			pth = syspth[0];
-			l = pthlen[0];
-			pthcat(pth, l, f->name);
-			v = is_diff_pth(pth, 0);
+	for (i = 0; i < 2 && !v; i++) {
+		if (S_ISDIR(f->type[i]) && f->cold) {
+			v = ddir_srch(f->cold->rdev[i], f->cold->ino[i]);
 		}
-
-		if (!v && f->type[1]) {
-			pth = syspth[1];
-			l = pthlen[1];
-			pthcat(pth, l, f->name);
-			v = is_diff_pth(pth, 0);
-		}
-
-		pth[l] = 0;
 	}
-
 #if defined(TRACE) && 0
 	fprintf(debug, "<-is_diff_dir: %d\n", v);
 #endif
@@ -931,42 +1365,27 @@ is_diff_pth(const char *p,
     /* 1: Remove path */
     unsigned m)
 {
-	char *rp = NULL;
+	struct stat st;
 	int v = 0;
-#ifdef HAVE_LIBAVLBST
-	struct bst_node *n;
-#else
-	char *n;
-#endif
 
 #if defined(TRACE) && 0
 	fprintf(debug, "->is_diff_pth(%s,%u)\n", p, m);
 #endif
-	/* Here since both path and name can be symlink */
-	if (!(rp = realpath(p, NULL))) {
-		printerr(strerror(errno), LOCFMT "realpath \"%s\""
+	/* stat() since both path and name can be symlink */
+	if (stat(p, &st) == -1) {
+		printerr(strerror(errno), LOCFMT "stat \"%s\""
 		    LOCVAR, p);
 		goto ret;
 	}
-#if defined(TRACE) && 0
-	fprintf(debug, "  realpath: \"%s\"\n", p);
-#endif
-	v = str_db_srch(&scan_db, rp, &n) ? 0 : 1;
+
+	v = ddir_srch(st.st_dev, st.st_ino);
 
 	if (m && v) {
 #if defined(TRACE) && 0
-		fprintf(debug, "  remove \"%s\"\n",
-#ifdef HAVE_LIBAVLBST
-		    rp
-#else
-		    n
+		fprintf(debug, "  remove \"%s\"\n", p);
 #endif
-		    );
-#endif
-		str_db_del(&scan_db, n);
+		ddir_del(st.st_dev, st.st_ino);
 	}
-
-	free(rp);
 ret:
 #if defined(TRACE) && 0
 	fprintf(debug, "<-is_diff_pth: %d\n", v);
@@ -974,10 +1393,12 @@ ret:
 	return v;
 }
 
+/* {a}: Arena of the list entry, NULL: Use malloc() */
+
 static char *
-read_link(char *path, off_t size)
+read_link(char *path, off_t size, struct arena *a)
 {
-	char *l = malloc(size + 1);
+	char *l = a ? arena_alloc(a, size + 1) : malloc(size + 1);
 
 	if ((size = readlink(path, l, size)) == -1) {
 		if (!ign_diff_errs && dialog(ign_txt, NULL,
@@ -985,7 +1406,12 @@ read_link(char *path, off_t size)
 		    strerror(errno)) == 'i')
 			ign_diff_errs = TRUE;
 
-		free(l);
+		if (a) {
+			arena_rel(a, l);
+		} else {
+			free(l);
+		}
+
 		return NULL;
 	}
 
@@ -997,17 +1423,19 @@ read_link(char *path, off_t size)
  * Output:
  * -1  Error, don't make DB entry
  *  0  No diff
- *  1  Diff */
+ *  1  Diff, the first different byte is at {cmp_off} (-1 if it is not
+ *     known: different sizes or found with the digest cache) */
 
 int
 cmp_file(char *lpth, off_t lsiz, char *rpth, off_t rsiz,
     /* 1 (!0): force compare, no getch */
     unsigned md)
 {
-	int rv = 0, f1, f2;
-	ssize_t l1, l2;
+	char ebuf[2 * PATHSIZ];
+	int rv = -2;
 
 	if (lsiz != rsiz) {
+		cmp_off = -1;
 		return 1;
 	}
 
@@ -1026,88 +1454,216 @@ cmp_file(char *lpth, off_t lsiz, char *rpth, off_t rsiz,
 		}
 	}
 
-	if ((f1 = open(lpth, O_RDONLY)) == -1) {
-		if (!ign_diff_errs && dialog(ign_txt, NULL,
-		    "open \"%s\": %s", lpth, strerror(errno)) == 'i')
-			ign_diff_errs = TRUE;
+	/* The digest cache is used by fcmp_data() */
+	if (use_uring && !dgst_max) {
+		rv = ur_cmp(&cmp_ctx, lpth, rpth, ebuf, sizeof ebuf);
+	}
 
-		return -1;
+	if (rv == -2) {
+		rv = fcmp_data(&cmp_ctx, lpth, rpth, ebuf, sizeof ebuf, NULL);
 	}
 
-	if ((f2 = open(rpth, O_RDONLY)) == -1) {
-		if (!ign_diff_errs && dialog(ign_txt, NULL,
-		    "open \"%s\": %s", rpth, strerror(errno)) == 'i')
+	if (rv == -1) {
+		if (!ign_diff_errs && dialog(ign_txt, NULL, "%s",
+		    ebuf) == 'i')
 			ign_diff_errs = TRUE;
+	} else if (rv == 1) {
+		cmp_off = cmp_ctx.off;
+	}
 
-		rv = -1;
-		goto close_f1;
+#if defined(TRACE) && 0
+fprintf(debug, "<>cmp_file: %d (off %lld): %s, %s\n", rv,
+    (long long)cmp_off, lpth, rpth);
+#endif
+	return rv;
+}
+
+/* statx() mask for the current list options */
+
+unsigned
+diff_stmask(void)
+{
+	unsigned m = 0;
+
+	if (add_owner || add_group) {
+		m |= STX_OWNER;
 	}
 
-	while (1) {
-		if ((l1 = read(f1, lbuf, sizeof lbuf)) == -1) {
-			if (!ign_diff_errs && dialog(ign_txt, NULL,
-			    "read \"%s\": %s", lpth,
-			    strerror(errno)) == 'i')
-				ign_diff_errs = TRUE;
+	if (add_mtime || sorting == SORTMTIME) {
+		m |= STX_MTIME;
+	}
 
-			rv = -1;
-			break;
-		}
+	return m;
+}
 
-		if ((l2 = read(f2, rbuf, sizeof rbuf)) == -1) {
-			if (!ign_diff_errs && dialog(ign_txt, NULL,
-			    "read \"%s\": %s", rpth,
-			    strerror(errno)) == 'i')
-				ign_diff_errs = TRUE;
+/* Get owner and mtime of a list entry if they had not been requested
+ * when the list was read. */
 
-			rv = -1;
-			break;
+void
+diff_fill(struct filediff *f)
+{
+	struct stat st;
+	char *p;
+	int i, r;
+
+	if (f->cold && !(f->fl & (FDFL_NOOWN | FDFL_NOMTIM))) {
+		return;
+	}
+
+	fd_cold(f);
+
+	for (i = 0; i < 2; i++) {
+		if (!f->type[i]) {
+			continue;
 		}
 
-		if (l1 != l2) {
-			rv = 1;
-			break;
+		if (*f->name == '/') {
+			p = f->name;
+		} else {
+			pthcat(syspth[i], pthlen[i], f->name);
+			p = syspth[i];
 		}
 
-		if (!l1)
-			break;
+		if (!followlinks ||
+		    (r = stx_stat(p, &st, STX_OWNER | STX_MTIME)) == -1) {
+			r = stx_lstat(p, &st, STX_OWNER | STX_MTIME);
+		}
 
-		if (memcmp(lbuf, rbuf, l1)) {
-			rv = 1;
-			break;
+		syspth[i][pthlen[i]] = 0;
+
+		if (r == -1) {
+			continue;
 		}
 
-		if (l1 < (ssize_t)(sizeof lbuf))
-			break;
+		f->cold->uid[i] = st.st_uid;
+		f->cold->gid[i] = st.st_gid;
+		f->cold->mtim[i] = st.st_mtim;
 	}
 
-	close(f2);
-close_f1:
-	close(f1);
-#if defined(TRACE) && 0
-fprintf(debug, "<>cmp_file: %d: %s, %s\n", rv, lpth, rpth);
-#endif
-	return rv;
+	f->fl &= ~(FDFL_NOOWN | FDFL_NOMTIM);
+}
+
+/* <0: Left file is older, >0: Right file is older */
+
+int
+diff_mtimcmp(struct filediff *f)
+{
+	struct timespec *t;
+
+	diff_fill(f);
+	t = f->cold->mtim;
+
+	if (t[0].tv_sec != t[1].tv_sec) {
+		return t[0].tv_sec < t[1].tv_sec ? -1 : 1;
+	}
+
+	return t[0].tv_nsec < t[1].tv_nsec ? -1 :
+	       t[0].tv_nsec > t[1].tv_nsec ?  1 : 0;
 }
 
+/* {col}: Column of the list (entry is allocated in its arena), -1 for
+ * temporary entries */
+
 static struct filediff *
-alloc_diff(char *name)
+alloc_diff(char *name, int col)
 {
-	struct filediff *p = malloc(sizeof(struct filediff));
-	p->name  = strdup(name);
-	p->llink = NULL; /* to simply use free() later */
-	p->rlink = NULL;
-	p->fl = 0;
-	p->diff  = ' ';
+	struct filediff *p;
+	struct arena *a;
+
+	if (col >= 0) {
+		a = diff_db_arena(col);
+		p = arena_alloc(a, sizeof(struct filediff));
+		p->name = arena_strdup(a, name);
+		p->fl = FDFL_ARENA | (col ? FDFL_COL1 : 0);
+	} else {
+		p = malloc(sizeof(struct filediff));
+		p->name = strdup(name);
+		p->fl = 0;
+	}
+
+	p->cold = NULL;
+	p->diff = ' ';
+	p->cat = 0;
 	return p;
 }
 
+/* NULL for temporary entries */
+
+static struct arena *
+fd_arena(struct filediff *f)
+{
+	return f->fl & FDFL_ARENA ?
+	    diff_db_arena(f->fl & FDFL_COL1 ? 1 : 0) : NULL;
+}
+
+static struct fdcold *
+fd_cold(struct filediff *f)
+{
+	struct arena *a;
+
+	if (!f->cold) {
+		f->cold = (a = fd_arena(f)) ?
+		    arena_alloc(a, sizeof(struct fdcold)) :
+		    malloc(sizeof(struct fdcold));
+		memset(f->cold, 0, sizeof(struct fdcold));
+	}
+
+	return f->cold;
+}
+
+/* Sets the cold fields of side {i} from {st}. They are only stored if
+ * they had been requested by {stm} or are needed for the file type.
+ * {lsiz} >= 0: Entry is or points to a symlink. */
+
+static void
+set_cold(struct filediff *f, int i, struct stat *st, unsigned stm,
+    off_t lsiz)
+{
+	struct fdcold *c;
+
+	if (!f->cold && !(stm & (STX_OWNER | STX_MTIME)) && lsiz < 0 &&
+	    !S_ISCHR(st->st_mode) && !S_ISBLK(st->st_mode) &&
+	    !S_ISDIR(st->st_mode)) {
+		return;
+	}
+
+	c = fd_cold(f);
+	c->uid[i]  = st->st_uid;
+	c->gid[i]  = st->st_gid;
+	c->mtim[i] = st->st_mtim;
+
+	if (S_ISDIR(st->st_mode)) {
+		c->rdev[i] = st->st_dev;
+		c->ino[i]  = st->st_ino;
+	} else {
+		c->rdev[i] = st->st_rdev;
+	}
+}
+
+/* Entries in an arena are released with the arena (diff_db_free()) */
+
 void
 free_diff(struct filediff *f)
 {
+	if (f->diff == '?') {
+		acmp_drop(f);
+	}
+
+	if (f->fl & FDFL_ARENA) {
+		return;
+	}
+
 	free(f->name);
-	free(f->llink);
-	free(f->rlink);
+
+	if (f->cold) {
+		if (f->cold->rlink != f->cold->llink) {
+			free(f->cold->rlink);
+		}
+
+		free(f->cold->llink);
+		free(f->cold);
+	}
+
 	free(f);
 }
 
@@ -1175,7 +1731,11 @@ do_scan(void)
 	fprintf(debug, "->do_scan lp(%s) rp(%s)\n", syspth[0], syspth[1]);
 #endif
 	scan = 1;
-	build_diff_db(bmode ? 1 : 3);
+
+	if (pscan()) {
+		build_diff_db(bmode ? 1 : 3);
+	}
+
 	stopscan = FALSE;
 	scan = 0;
 #if defined(TRACE) && 0
@@ -1,22 +1,51 @@
 /* File marked (for delete, copy, etc.) */
 #define FDFL_MMRK 1
+/* Fields had not been requested by the statx() mask. diff_fill() gets
+ * them. */
+#define FDFL_NOOWN  2
+#define FDFL_NOMTIM 4
+/* Allocated in the arena of the list */
+#define FDFL_ARENA  8
+/* Arena of the right column (fmode) */
+#define FDFL_COL1   16
 
-struct filediff {
-	char   *name;
+/* Fields which are not needed to build and display the list itself.
+ * Only allocated for entries which have any of them set. */
+
+struct fdcold {
 	char   *llink, *rlink;
-	mode_t  type[2];
+	struct timespec mtim[2];
 	uid_t   uid[2];
 	gid_t   gid[2];
+	dev_t   rdev[2]; /* S_ISCHR, S_ISBLK: st_rdev, S_ISDIR: st_dev */
+	ino_t   ino[2];  /* S_ISDIR: st_ino, see is_diff_dir() */
+};
+
+struct filediff {
+	char   *name;
+	struct fdcold *cold; /* NULL: All cold fields are 0. After
+	                      * diff_fill() it is always set. */
 	off_t   siz[2];
-	time_t  mtim[2];
-	dev_t   rdev[2];
-	unsigned fl;
+	mode_t  type[2];
+	unsigned char fl;
 	char    diff;
+	unsigned short cat; /* Filter category, see db.c */
 };
 
+#define FD_LLINK(f) ((f)->cold ? (f)->cold->llink : NULL)
+#define FD_RLINK(f) ((f)->cold ? (f)->cold->rlink : NULL)
+#define FD_RDEV(f, i) ((f)->cold ? (f)->cold->rdev[i] : 0)
+
+/* scan_subdir(): The listing may be taken from the list cache */
+#define SCAN_LC 4
+
 extern short followlinks;
+extern short ino_order;
+extern off_t cmp_off;
 extern bool one_scan;
 extern bool dotdot;
+extern bool ign_diff_errs;
+extern bool inc_list;
 
 int build_diff_db(int);
 int scan_subdir(char *, char *, int);
@@ -24,6 +53,11 @@ int is_diff_dir(struct filediff *);
 int is_diff_pth(const char *, unsigned);
 size_t pthcat(char *, size_t, const char *);
 int cmp_file(char *, off_t, char *, off_t, unsigned);
+void add_diff_pth(const char *);
+void ini_int(void);
+unsigned diff_stmask(void);
+void diff_fill(struct filediff *);
+int diff_mtimcmp(struct filediff *);
 void free_diff(struct filediff *);
 void do_scan(void);
 void save_last_path(char *);
@@ -0,0 +1,321 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Directory name vectors.  A directory is read in one go into a single
+ * string buffer.  The names are sorted and two sorted vectors are paired
+ * in a linear merge.  Used instead of a search tree with one node per
+ * name.  Thread-safe (no UI calls).
+ *
+ * On Linux the directory is read with getdents64(2) into a large buffer.
+ * The d_type of each name is saved in the byte before the name and allows
+ * the scan to skip stat(2) for many files.  The d_ino before it allows to
+ * stat(2) the names in inode order. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_GETDENTS64
+# include <stdint.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/syscall.h>
+#endif
+#include "dnam.h"
+
+#ifdef HAVE_GETDENTS64
+# define GETDENTS_SIZ (256 * 1024)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+#endif
+
+#ifndef DTTOIF
+# define DTTOIF(t) ((t) << 12)
+#endif
+
+static void dnam_add(struct dnam *, const char *, ino_t, int, int,
+    size_t *, size_t *, size_t **);
+static int dnam_cmp(const void *, const void *);
+static int dnam_icmp(const void *, const void *);
+
+struct dnam_ino {
+	ino_t ino;
+	size_t i;
+};
+
+/* 0: OK, -1: opendir() failed, -2: readdir() failed.  errno is set on
+ * error.  For -2 {d} contains the names read before the error.
+ * {dots}: Keep "..". */
+
+int
+dnam_read(struct dnam *d, const char *pth, int dots)
+{
+#ifdef HAVE_GETDENTS64
+	int fd;
+	char *b;
+	long n, i;
+	struct linux_dirent64 *de;
+#else
+	DIR *dh;
+	struct dirent *ent;
+#endif
+	size_t bsiz = 0, vsiz = 0, *o = NULL, i2;
+	int r = 0, e = 0;
+
+	memset(d, 0, sizeof(struct dnam));
+
+#ifdef HAVE_GETDENTS64
+	if ((fd = open(pth, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		return -1;
+	}
+
+	b = malloc(GETDENTS_SIZ);
+
+	while ((n = syscall(SYS_getdents64, fd, b, GETDENTS_SIZ))) {
+		if (n == -1) {
+			e = errno;
+			r = -2;
+			break;
+		}
+
+		for (i = 0; i < n; i += de->d_reclen) {
+			de = (struct linux_dirent64 *)(b + i);
+			dnam_add(d, de->d_name, de->d_ino, de->d_type, dots,
+			    &bsiz, &vsiz, &o);
+		}
+	}
+
+	free(b);
+	close(fd);
+#else
+	if (!(dh = opendir(pth))) {
+		return -1;
+	}
+
+	while (1) {
+		errno = 0;
+
+		if (!(ent = readdir(dh))) {
+			if (errno) {
+				e = errno;
+				r = -2;
+			}
+
+			break;
+		}
+
+		dnam_add(d, ent->d_name, ent->d_ino,
+# ifdef DT_UNKNOWN
+		    ent->d_type,
+# else
+		    0,
+# endif
+		    dots, &bsiz, &vsiz, &o);
+	}
+
+	closedir(dh);
+#endif
+
+	if (d->num) {
+		d->v = malloc(d->num * sizeof(char *));
+		d->pr = calloc(d->num, 1);
+
+		for (i2 = 0; i2 < d->num; i2++) {
+			d->v[i2] = d->buf + o[i2];
+		}
+
+		qsort(d->v, d->num, sizeof(char *), dnam_cmp);
+	}
+
+	free(o);
+	errno = e;
+	return r;
+}
+
+static void
+dnam_add(struct dnam *d, const char *name, ino_t ino, int typ, int dots,
+    size_t *bsiz, size_t *vsiz, size_t **o)
+{
+	size_t l;
+
+	if (*name == '.' && (!name[1] ||
+	    (!dots && name[1] == '.' && !name[2]))) {
+		return;
+	}
+
+	l = strlen(name) + 1;
+
+	if (d->len + sizeof ino + l + 1 > *bsiz) {
+		do {
+			*bsiz = *bsiz ? 2 * *bsiz : 4096;
+		} while (d->len + sizeof ino + l + 1 > *bsiz);
+
+		d->buf = realloc(d->buf, *bsiz);
+	}
+
+	if (d->num == *vsiz) {
+		*vsiz = *vsiz ? 2 * *vsiz : 64;
+		*o = realloc(*o, *vsiz * sizeof(size_t));
+	}
+
+	/* Unaligned */
+	memcpy(d->buf + d->len, &ino, sizeof ino);
+	d->len += sizeof ino;
+	d->buf[d->len++] = typ;
+	/* Offsets since {buf} may move */
+	(*o)[d->num++] = d->len;
+	memcpy(d->buf + d->len, name, l);
+	d->len += l;
+}
+
+/* Set pr[] of the names which exist on both sides to DNAM_PR and the d_type
+ * of the name on the other side */
+
+void
+dnam_pair(struct dnam *l, struct dnam *r)
+{
+	size_t i = 0, j = 0;
+	int c;
+
+	while (i < l->num && j < r->num) {
+		if (!(c = strcmp(l->v[i], r->v[j]))) {
+			l->pr[i++] = DNAM_PR | DNAM_TYP(r->v[j]);
+			r->pr[j++] = DNAM_PR | DNAM_TYP(l->v[i-1]);
+		} else if (c < 0) {
+			i++;
+		} else {
+			j++;
+		}
+	}
+}
+
+/* Checks if the scan can do without stat(2) for a name.  {lt}, {rt}:
+ * d_type of the left and right name, -1 if the name does not exist on the
+ * right side.  {flw}: Follow links.  {fnam}: Only the directory type is
+ * needed (find mode).
+ * 1: No stat() necessary, {m} is set to the file types.  0: Use stat() */
+
+int
+dnam_notstat(int lt, int rt, int flw, int fnam, mode_t *m)
+{
+#ifdef DT_UNKNOWN
+	if (flw) {
+		if (lt == DT_LNK) {
+			lt = DT_UNKNOWN;
+		}
+
+		if (rt == DT_LNK) {
+			rt = DT_UNKNOWN;
+		}
+	}
+
+	if (lt == DT_UNKNOWN || rt == DT_UNKNOWN) {
+		return 0;
+	}
+
+	/* Size, link target or permissions are needed to compare files of
+	 * the same type */
+	if (!fnam && rt == lt && lt != DT_DIR) {
+		return 0;
+	}
+
+	m[0] = DTTOIF(lt);
+	m[1] = rt < 0 ? 0 : DTTOIF(rt);
+	return 1;
+#else
+	(void)lt;
+	(void)rt;
+	(void)flw;
+	(void)fnam;
+	(void)m;
+	return 0;
+#endif
+}
+
+/* d_ino of name {s} of a struct dnam */
+
+ino_t
+dnam_ino(const char *s)
+{
+	ino_t i;
+
+	memcpy(&i, s - 1 - sizeof i, sizeof i);
+	return i;
+}
+
+/* Returns the indices of the names of {d} sorted by d_ino (malloc'ed),
+ * NULL if {d} is empty.  On most file systems this is about the order of
+ * the inodes on disk, the stat(2) calls in this order need less seeks than
+ * in name order. */
+
+size_t *
+dnam_inoord(struct dnam *d)
+{
+	struct dnam_ino *t;
+	size_t *o, i;
+
+	if (!d->num) {
+		return NULL;
+	}
+
+	t = malloc(d->num * sizeof(struct dnam_ino));
+
+	for (i = 0; i < d->num; i++) {
+		t[i].ino = dnam_ino(d->v[i]);
+		t[i].i = i;
+	}
+
+	qsort(t, d->num, sizeof(struct dnam_ino), dnam_icmp);
+	o = malloc(d->num * sizeof(size_t));
+
+	for (i = 0; i < d->num; i++) {
+		o[i] = t[i].i;
+	}
+
+	free(t);
+	return o;
+}
+
+void
+dnam_free(struct dnam *d)
+{
+	free(d->buf);
+	free(d->v);
+	free(d->pr);
+	memset(d, 0, sizeof(struct dnam));
+}
+
+static int
+dnam_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int
+dnam_icmp(const void *a, const void *b)
+{
+	const struct dnam_ino *x = a, *y = b;
+
+	return x->ino < y->ino ? -1 : x->ino > y->ino ? 1 : 0;
+}
@@ -0,0 +1,28 @@
+/* d_type of a name in struct dnam, DT_UNKNOWN if not known */
+#define DNAM_TYP(s) (((unsigned char *)(s))[-1])
+#define DNAM_PR 0x80
+/* d_type of the paired name in the other directory */
+#define DNAM_PRTYP(c) ((c) & ~DNAM_PR)
+#ifdef DT_UNKNOWN
+/* An lstat() is necessary to find out if it is a link */
+# define DNAM_MAYLNK(t) ((t) == DT_LNK || (t) == DT_UNKNOWN)
+#else
+# define DNAM_MAYLNK(t) 1
+#endif
+
+struct dnam {
+	/* all names, NUL terminated, each preceded by d_ino and d_type */
+	char *buf;
+	size_t len;
+	char **v; /* sorted names */
+	/* !0: Name exists in the other directory too (set by dnam_pair()) */
+	unsigned char *pr;
+	size_t num;
+};
+
+int dnam_read(struct dnam *, const char *, int);
+void dnam_pair(struct dnam *, struct dnam *);
+void dnam_free(struct dnam *);
+ino_t dnam_ino(const char *);
+size_t *dnam_inoord(struct dnam *);
+int dnam_notstat(int, int, int, int, mode_t *);
@@ -0,0 +1,650 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* File compare engine.  Each compare context has its own buffers which
+ * are sized to the file and the I/O block size of the device.  The chunks
+ * are compared by a vector kernel which is selected at runtime by the
+ * CPU features and returns the offset of the first different byte.
+ * Thread-safe after fcmp_init().
+ *
+ * If the files are on different devices and are larger than one chunk,
+ * the right file is read ahead by a reader thread into two buffers while
+ * the left file is read and compared.  Both devices are busy at the same
+ * time then.
+ *
+ * With the digest cache the digests of both files are looked up first.  If
+ * both are found, no byte is read.  If the files are equal, the digest is
+ * computed on the fly and saved for both files.
+ *
+ * mmap(2) is not used since a file which is truncated while it is compared
+ * would raise SIGBUS. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# ifdef __SSE2__
+#  define FCMP_SSE2
+# endif
+# ifdef HAVE_AVX2
+#  define FCMP_AVX2
+# endif
+# if defined(FCMP_SSE2) || defined(FCMP_AVX2)
+#  include <immintrin.h>
+# endif
+#elif defined(__GNUC__) && defined(__aarch64__)
+# define FCMP_NEON
+# include <arm_neon.h>
+#endif
+#include "dgst.h"
+#include "fcmp.h"
+
+/* Chunk size limits per file */
+#define FCMP_MIN (64 * 1024)
+#define FCMP_MAX (1024 * 1024)
+#define FCMP_ALGN 4096
+
+static size_t cmp_scal(const unsigned char *, const unsigned char *, size_t);
+#ifdef FCMP_SSE2
+static size_t cmp_sse2(const unsigned char *, const unsigned char *, size_t);
+#endif
+#ifdef FCMP_AVX2
+static size_t cmp_avx2(const unsigned char *, const unsigned char *, size_t);
+#endif
+#ifdef FCMP_NEON
+static size_t cmp_neon(const unsigned char *, const unsigned char *, size_t);
+#endif
+static size_t fcmp_bsiz(struct stat *, struct stat *);
+static int fcmp_loop(struct fcmp *, int, int, size_t, const char *,
+    const char *, char *, size_t, volatile int *);
+static int fcmp_hash(struct fcmp *, int, size_t, struct stat *, uint64_t *,
+    const char *, char *, size_t, volatile int *);
+#ifdef HAVE_PTHREAD
+/* Reader thread of the right file */
+
+struct fcmp_rd {
+	pthread_t tid;
+	pthread_mutex_t mtx;
+	pthread_cond_t cnd;
+	int fd;
+	size_t n;
+	char *buf[2];
+	ssize_t len[2];
+	int err[2];
+	int full[2];
+	int stop;
+};
+
+static int fcmp_pipe(struct fcmp *, int, int, size_t, const char *,
+    const char *, char *, size_t, volatile int *);
+static void *fcmp_rdthr(void *);
+#endif
+
+static size_t (*fcmp_kern)(const unsigned char *, const unsigned char *,
+    size_t) = cmp_scal;
+static const char *fcmp_knam = "scalar";
+
+/* Selects the compare kernel.  Is to be called before any thread is
+ * started. */
+
+void
+fcmp_init(void)
+{
+#ifdef FCMP_SSE2
+	fcmp_kern = cmp_sse2;
+	fcmp_knam = "sse2";
+#endif
+#ifdef FCMP_AVX2
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		fcmp_kern = cmp_avx2;
+		fcmp_knam = "avx2";
+	}
+#endif
+#ifdef FCMP_NEON
+	fcmp_kern = cmp_neon;
+	fcmp_knam = "neon";
+#endif
+}
+
+/* Name of the selected kernel */
+
+const char *
+fcmp_name(void)
+{
+	return fcmp_knam;
+}
+
+/* Returns the index of the first different byte of {a} and {b}, {n} if
+ * both are equal */
+
+size_t
+fcmp_mem(const void *a, const void *b, size_t n)
+{
+	return fcmp_kern(a, b, n);
+}
+
+/* Makes sure that {c} has {nb} buffers of at least {n} bytes */
+
+char *
+fcmp_buf(struct fcmp *c, size_t n, int nb)
+{
+	if (n > c->siz || nb > c->nbuf) {
+		if (n < c->siz) {
+			n = c->siz;
+		}
+
+		if (nb < c->nbuf) {
+			nb = c->nbuf;
+		}
+
+		free(c->buf);
+
+		if (!(c->buf = malloc(nb * n))) {
+			c->siz = 0;
+			c->nbuf = 0;
+			return NULL;
+		}
+
+		c->siz = n;
+		c->nbuf = nb;
+	}
+
+	return c->buf;
+}
+
+void
+fcmp_free(struct fcmp *c)
+{
+	free(c->buf);
+	memset(c, 0, sizeof(struct fcmp));
+}
+
+/* I/O size for files {s1} and {s2}: A small file is read with one read(2),
+ * larger files in chunks of a multiple of the device block size. */
+
+static size_t
+fcmp_bsiz(struct stat *s1, struct stat *s2)
+{
+	size_t n, b;
+
+	b = s1->st_blksize > s2->st_blksize ? s1->st_blksize :
+	    s2->st_blksize;
+
+	if (s1->st_size >= FCMP_MAX) {
+		n = FCMP_MAX;
+	} else {
+		/* +1 to see EOF in the first read */
+		n = s1->st_size + 1;
+
+		if (n < FCMP_MIN) {
+			n = FCMP_MIN;
+		}
+	}
+
+	if (b > FCMP_ALGN && b <= FCMP_MAX) {
+		n = (n + b - 1) / b * b;
+	} else {
+		n = (n + FCMP_ALGN - 1) / FCMP_ALGN * FCMP_ALGN;
+	}
+
+	return n;
+}
+
+/* Compares the contents of files {lpth} and {rpth}.  No user interaction,
+ * only the buffers of {c} are used.  If {stop} is not NULL, the compare is
+ * stopped (result 0) when *stop is set by another thread.
+ * -1  Error, message in {ebuf}
+ *  0  No diff
+ *  1  Diff, c->off is the offset of the first different byte */
+
+int
+fcmp_data(struct fcmp *c, const char *lpth, const char *rpth, char *ebuf,
+    size_t esiz, volatile int *stop)
+{
+	int rv = 0, f1, f2, hit = 0;
+	struct stat s1, s2;
+	size_t n;
+	struct dgst_st ds;
+	uint64_t h[2][2];
+
+	c->off = 0;
+
+	if ((f1 = open(lpth, O_RDONLY)) == -1) {
+		snprintf(ebuf, esiz, "open \"%s\": %s", lpth,
+		    strerror(errno));
+		return -1;
+	}
+
+	if ((f2 = open(rpth, O_RDONLY)) == -1) {
+		snprintf(ebuf, esiz, "open \"%s\": %s", rpth,
+		    strerror(errno));
+		rv = -1;
+		goto close_f1;
+	}
+
+	if (fstat(f1, &s1) == -1 || fstat(f2, &s2) == -1) {
+		snprintf(ebuf, esiz, "fstat \"%s\": %s", lpth,
+		    strerror(errno));
+		rv = -1;
+		goto close_f2;
+	}
+
+	n = fcmp_bsiz(&s1, &s2);
+
+	if (dgst_max && S_ISREG(s1.st_mode) && S_ISREG(s2.st_mode) &&
+	    s1.st_size == s2.st_size) {
+		hit = (dgst_get(&s1, h[0]) ? 0 : 1) |
+		    (dgst_get(&s2, h[1]) ? 0 : 2);
+
+		/* Compute the missing digest if the other one is known */
+		if ((hit == 1 && fcmp_hash(c, f2, n, &s2, h[1], rpth, ebuf,
+		    esiz, stop)) || (hit == 2 && fcmp_hash(c, f1, n, &s1,
+		    h[0], lpth, ebuf, esiz, stop))) {
+			rv = -1;
+			goto close_f2;
+		}
+
+		if (hit) {
+			if (memcmp(h[0], h[1], sizeof h[0])) {
+				/* Offset is not known */
+				c->off = -1;
+				rv = 1;
+			}
+
+			goto close_f2;
+		}
+
+		dgst_init(&ds);
+		c->hs = &ds;
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	if (s1.st_size > FCMP_MAX) {
+		/* Larger readahead */
+		posix_fadvise(f1, 0, 0, POSIX_FADV_SEQUENTIAL);
+		posix_fadvise(f2, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+#endif
+#ifdef HAVE_PTHREAD
+	if (s1.st_size > (off_t)n && s1.st_dev != s2.st_dev &&
+	    (rv = fcmp_pipe(c, f1, f2, n, lpth, rpth, ebuf, esiz, stop)) !=
+	    -2) {
+		goto save;
+	}
+#endif
+
+	rv = fcmp_loop(c, f1, f2, n, lpth, rpth, ebuf, esiz, stop);
+
+save:
+	if (c->hs) {
+		/* Equal files have the same digest */
+		if (!rv && !(stop && *stop)) {
+			dgst_fin(c->hs, h[0]);
+			dgst_put(&s1, h[0]);
+			dgst_put(&s2, h[0]);
+		}
+
+		c->hs = NULL;
+	}
+
+close_f2:
+	close(f2);
+close_f1:
+	close(f1);
+	return rv;
+}
+
+/* Computes the digest of file {fd} with stat data {st} into {h} and
+ * saves it in the digest cache.  -1: Error, 0: OK */
+
+static int
+fcmp_hash(struct fcmp *c, int fd, size_t n, struct stat *st, uint64_t *h,
+    const char *pth, char *ebuf, size_t esiz, volatile int *stop)
+{
+	struct dgst_st ds;
+	ssize_t l;
+	char *b;
+
+	if (!(b = fcmp_buf(c, n, 2))) {
+		snprintf(ebuf, esiz, "malloc: %s", strerror(errno));
+		return -1;
+	}
+
+	dgst_init(&ds);
+
+	while ((l = read(fd, b, n))) {
+		if (l == -1) {
+			snprintf(ebuf, esiz, "read \"%s\": %s", pth,
+			    strerror(errno));
+			return -1;
+		}
+
+		dgst_upd(&ds, b, l);
+
+		if (stop && *stop) {
+			/* Result is not used */
+			dgst_fin(&ds, h);
+			return 0;
+		}
+	}
+
+	dgst_fin(&ds, h);
+	dgst_put(st, h);
+	return 0;
+}
+
+/* Reads and compares both files in turn */
+
+static int
+fcmp_loop(struct fcmp *c, int f1, int f2, size_t n, const char *lpth,
+    const char *rpth, char *ebuf, size_t esiz, volatile int *stop)
+{
+	int rv = 0;
+	ssize_t l1, l2;
+	size_t i;
+	char *b1, *b2;
+
+	if (!(b1 = fcmp_buf(c, n, 2))) {
+		snprintf(ebuf, esiz, "malloc: %s", strerror(errno));
+		return -1;
+	}
+
+	b2 = b1 + c->siz;
+
+	while (1) {
+		if ((l1 = read(f1, b1, n)) == -1) {
+			snprintf(ebuf, esiz, "read \"%s\": %s", lpth,
+			    strerror(errno));
+			rv = -1;
+			break;
+		}
+
+		if ((l2 = read(f2, b2, n)) == -1) {
+			snprintf(ebuf, esiz, "read \"%s\": %s", rpth,
+			    strerror(errno));
+			rv = -1;
+			break;
+		}
+
+		i = fcmp_kern((unsigned char *)b1, (unsigned char *)b2,
+		    l1 < l2 ? l1 : l2);
+
+		if (l1 != l2 || i < (size_t)l1) {
+			c->off += i;
+			rv = 1;
+			break;
+		}
+
+		c->off += l1;
+
+		if (c->hs) {
+			dgst_upd(c->hs, b1, l1);
+		}
+
+		if ((size_t)l1 < n)
+			break;
+
+		if (stop && *stop)
+			break;
+	}
+
+	return rv;
+}
+
+#ifdef HAVE_PTHREAD
+/* Reads the left file and compares it with the chunks of the reader
+ * thread.  -2: Thread could not be started. */
+
+static int
+fcmp_pipe(struct fcmp *c, int f1, int f2, size_t n, const char *lpth,
+    const char *rpth, char *ebuf, size_t esiz, volatile int *stop)
+{
+	struct fcmp_rd r;
+	int rv = 0, k = 0;
+	ssize_t l1, l2;
+	size_t i;
+	char *b1;
+
+	if (!(b1 = fcmp_buf(c, n, 3))) {
+		return -2;
+	}
+
+	memset(&r, 0, sizeof r);
+	r.fd = f2;
+	r.n = n;
+	r.buf[0] = b1 + c->siz;
+	r.buf[1] = b1 + 2 * c->siz;
+	pthread_mutex_init(&r.mtx, NULL);
+	pthread_cond_init(&r.cnd, NULL);
+
+	if (pthread_create(&r.tid, NULL, fcmp_rdthr, &r)) {
+		rv = -2;
+		goto destroy;
+	}
+
+	while (1) {
+		if ((l1 = read(f1, b1, n)) == -1) {
+			snprintf(ebuf, esiz, "read \"%s\": %s", lpth,
+			    strerror(errno));
+			rv = -1;
+			break;
+		}
+
+		pthread_mutex_lock(&r.mtx);
+
+		while (!r.full[k]) {
+			pthread_cond_wait(&r.cnd, &r.mtx);
+		}
+
+		l2 = r.len[k];
+		pthread_mutex_unlock(&r.mtx);
+
+		if (l2 == -1) {
+			snprintf(ebuf, esiz, "read \"%s\": %s", rpth,
+			    strerror(r.err[k]));
+			rv = -1;
+			break;
+		}
+
+		i = fcmp_kern((unsigned char *)b1, (unsigned char *)r.buf[k],
+		    l1 < l2 ? l1 : l2);
+
+		if (l1 != l2 || i < (size_t)l1) {
+			c->off += i;
+			rv = 1;
+			break;
+		}
+
+		c->off += l1;
+
+		if (c->hs) {
+			dgst_upd(c->hs, b1, l1);
+		}
+
+		if ((size_t)l1 < n)
+			break;
+
+		if (stop && *stop)
+			break;
+
+		pthread_mutex_lock(&r.mtx);
+		r.full[k] = 0;
+		pthread_cond_broadcast(&r.cnd);
+		pthread_mutex_unlock(&r.mtx);
+		k ^= 1;
+	}
+
+	pthread_mutex_lock(&r.mtx);
+	r.stop = 1;
+	pthread_cond_broadcast(&r.cnd);
+	pthread_mutex_unlock(&r.mtx);
+	pthread_join(r.tid, NULL);
+destroy:
+	pthread_cond_destroy(&r.cnd);
+	pthread_mutex_destroy(&r.mtx);
+	return rv;
+}
+
+static void *
+fcmp_rdthr(void *arg)
+{
+	struct fcmp_rd *r = arg;
+	int k = 0, e;
+	ssize_t l;
+
+	while (1) {
+		pthread_mutex_lock(&r->mtx);
+
+		while (r->full[k] && !r->stop) {
+			pthread_cond_wait(&r->cnd, &r->mtx);
+		}
+
+		if (r->stop) {
+			pthread_mutex_unlock(&r->mtx);
+			break;
+		}
+
+		pthread_mutex_unlock(&r->mtx);
+		l = read(r->fd, r->buf[k], r->n);
+		e = errno;
+		pthread_mutex_lock(&r->mtx);
+		r->len[k] = l;
+		r->err[k] = e;
+		r->full[k] = 1;
+		pthread_cond_broadcast(&r->cnd);
+		pthread_mutex_unlock(&r->mtx);
+
+		/* Error or EOF */
+		if (l < (ssize_t)r->n) {
+			break;
+		}
+
+		k ^= 1;
+	}
+
+	return NULL;
+}
+#endif
+
+static size_t
+cmp_scal(const unsigned char *a, const unsigned char *b, size_t n)
+{
+	size_t i = 0;
+	uint64_t x, y;
+
+	for (; i + 8 <= n; i += 8) {
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+
+		if (x != y)
+			break;
+	}
+
+	for (; i < n && a[i] == b[i]; i++);
+
+	return i;
+}
+
+#ifdef FCMP_SSE2
+static size_t
+cmp_sse2(const unsigned char *a, const unsigned char *b, size_t n)
+{
+	size_t i = 0;
+	__m128i e0, e1;
+	unsigned m;
+
+	for (; i + 32 <= n; i += 32) {
+		e0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+		    _mm_loadu_si128((const __m128i *)(b + i)));
+		e1 = _mm_cmpeq_epi8(
+		    _mm_loadu_si128((const __m128i *)(a + i + 16)),
+		    _mm_loadu_si128((const __m128i *)(b + i + 16)));
+
+		if (_mm_movemask_epi8(_mm_and_si128(e0, e1)) == 0xffff)
+			continue;
+
+		if ((m = _mm_movemask_epi8(e0)) != 0xffff)
+			return i + __builtin_ctz(~m);
+
+		m = _mm_movemask_epi8(e1);
+		return i + 16 + __builtin_ctz(~m);
+	}
+
+	return i + cmp_scal(a + i, b + i, n - i);
+}
+#endif
+
+#ifdef FCMP_AVX2
+__attribute__((target("avx2")))
+static size_t
+cmp_avx2(const unsigned char *a, const unsigned char *b, size_t n)
+{
+	size_t i = 0;
+	__m256i e0, e1;
+	unsigned m;
+
+	for (; i + 64 <= n; i += 64) {
+		e0 = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)(a + i)),
+		    _mm256_loadu_si256((const __m256i *)(b + i)));
+		e1 = _mm256_cmpeq_epi8(
+		    _mm256_loadu_si256((const __m256i *)(a + i + 32)),
+		    _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+
+		if ((unsigned)_mm256_movemask_epi8(_mm256_and_si256(e0, e1)) ==
+		    0xffffffff)
+			continue;
+
+		if ((m = _mm256_movemask_epi8(e0)) != 0xffffffff)
+			return i + __builtin_ctz(~m);
+
+		m = _mm256_movemask_epi8(e1);
+		return i + 32 + __builtin_ctz(~m);
+	}
+
+	return i + cmp_scal(a + i, b + i, n - i);
+}
+#endif
+
+#ifdef FCMP_NEON
+static size_t
+cmp_neon(const unsigned char *a, const unsigned char *b, size_t n)
+{
+	size_t i = 0;
+	uint8x16_t e0, e1;
+
+	for (; i + 32 <= n; i += 32) {
+		e0 = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+		e1 = vceqq_u8(vld1q_u8(a + i + 16), vld1q_u8(b + i + 16));
+
+		if (vminvq_u8(vandq_u8(e0, e1)) != 0xff)
+			break;
+	}
+
+	return i + cmp_scal(a + i, b + i, n - i);
+}
+#endif
@@ -0,0 +1,17 @@
+struct dgst_st;
+
+struct fcmp {
+	char *buf; /* {nbuf} buffers of {siz} bytes each */
+	size_t siz;
+	int nbuf;
+	off_t off; /* offset of the first difference, -1 if not known */
+	struct dgst_st *hs; /* digest of the equal part, NULL: none */
+};
+
+void fcmp_init(void);
+const char *fcmp_name(void);
+size_t fcmp_mem(const void *, const void *, size_t);
+char *fcmp_buf(struct fcmp *, size_t, int);
+void fcmp_free(struct fcmp *);
+int fcmp_data(struct fcmp *, const char *, const char *, char *, size_t,
+    volatile int *);
@@ -43,6 +43,9 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "ed.h"
 #include "tc.h"
 #include "misc.h"
+#include "stx.h"
+#include "lcache.h"
+#include "pfch.h"
 
 struct str_list {
 	char *s;
@@ -820,8 +823,8 @@ fs_cp(
 		syspth[0][pthlen[0]] = 0;
 		syspth[1][pthlen[1]] = 0;
 
-		if (fs_stat(syspth[0], &gstat[0], 0) == -1 ||
-		    fs_stat(syspth[1], &gstat[1], 0) == -1) {
+		if (fs_stat(syspth[0], &gstat[0], 2) == -1 ||
+		    fs_stat(syspth[1], &gstat[1], 2) == -1) {
 #if defined(TRACE)
 			fprintf(debug, "  stat \"%s\", \"%s\" error\n",
 			    syspth[0], syspth[1]);
@@ -886,7 +889,7 @@ tpth:
 #if defined(TRACE)
 		fprintf(debug, "  fs_cp dst path(%s)\n", pth2);
 #endif
-		i = fs_stat(pth2, &gstat[1], 0);
+		i = fs_stat(pth2, &gstat[1], 2);
 
 		if (i == -1) { /* from stat */
 			if (errno != ENOENT) {
@@ -927,7 +930,7 @@ tpth:
 		fprintf(debug, "  Copy \"%s\" -> \"%s\"\n", pth1, pth2);
 #endif
 		if (md & 2) {
-			if (!fs_stat(pth2, &gstat[1], 0) &&
+			if (!fs_stat(pth2, &gstat[1], 2) &&
 			    fs_rm(0 /* tree */, "overwrite", NULL /* nam */,
 			    0 /* u */, 1 /* n */, 4|2 /* md */) == 1) {
 				goto ret;
@@ -1042,8 +1045,8 @@ fs_cat(
 	       mark_rnam ? mark_rnam :
 	       "<error>" ;
 
-	if (fs_stat(pth1, &gstat[0], 1) == -1 ||
-	    fs_stat(pth2, &gstat[1], 1)) {
+	if (fs_stat(pth1, &gstat[0], 1|2) == -1 ||
+	    fs_stat(pth2, &gstat[1], 1|2)) {
 		goto ret;
 	}
 
@@ -1114,9 +1117,20 @@ rebuild_db(
 		mark_global();
 	}
 
+	/* Cached listings may have been built with other options */
+	lc_flush();
+	pf_flush();
+
 	if (!(mode & 4)) {
 		diff_db_free(0);
-		build_diff_db(bmode || fmode ? 1 : subtree);
+
+		if (!bmode && !fmode) {
+			lc_new(subtree);
+		}
+
+		if (build_diff_db(bmode || fmode ? 1 : subtree)) {
+			lc_drop();
+		}
 	}
 
 	if (fmode && !(mode & 2)) {
@@ -1350,11 +1364,11 @@ fs_testBreak(void)
 static int
 creatdir(void)
 {
-	if (fs_stat(pth1, &gstat[0], 0) == -1) {
+	if (fs_stat(pth1, &gstat[0], 2) == -1) {
 		return -1;
 	}
 
-	if (!fs_stat(pth2, &gstat[1], 0)) {
+	if (!fs_stat(pth2, &gstat[1], 2)) {
 		if (S_ISDIR(gstat[1].st_mode)) {
 			/* Respect write protected dirs, don't make them
 			 * writeable */
@@ -1399,7 +1413,7 @@ cp_link(void)
 
 	buf[l] = 0;
 
-	if (!fs_stat(pth2, &gstat[1], 0) &&
+	if (!fs_stat(pth2, &gstat[1], 2) &&
 	    fs_rm(0 /* tree */, "overwrite", NULL /* nam */,
 	    0 /* u */, 1 /* n */, 4|2 /* md */) == 1) {
 		r = 1;
@@ -1441,7 +1455,7 @@ cp_reg(
 	fprintf(debug, "->cp_reg(%u) \"%s\" -> \"%s\"\n", mode, pth1, pth2);
 #endif
 
-	if (!fs_stat(pth2, &gstat[1], 0)) {
+	if (!fs_stat(pth2, &gstat[1], 2)) {
 #if defined(TRACE)
 		fprintf(debug, "  Already exists: %s\n", pth2);
 #endif
@@ -1631,7 +1645,7 @@ fs_get_dst(long u,
     unsigned m)
 {
 	struct filediff *f;
-	int dst = 0;
+	int dst = 0, c;
 
 	if (bmode) {
 		dst = 2;
@@ -1655,10 +1669,10 @@ fs_get_dst(long u,
 
 					/* return 0 */
 
-				} else if (f->mtim[0] < f->mtim[1]) {
+				} else if ((c = diff_mtimcmp(f)) < 0) {
 					dst = 1;
 
-				} else if (f->mtim[0] > f->mtim[1]) {
+				} else if (c > 0) {
 					dst = 2;
 				}
 
@@ -1692,13 +1706,15 @@ fs_any_dst(long u, int n, unsigned m)
 
 static int
 fs_stat(const char *p, struct stat *s,
-    /* 1: report ENOENT */
+    /* 1: report ENOENT
+     * 2: Only type, mode, size, inode and device are needed */
     unsigned mode)
 {
 	int i;
+	unsigned m = mode & 2 ? 0 : STX_ALL;
 
-	if (( followlinks && (i =  stat(p, s)) == -1) ||
-	    (!followlinks && (i = lstat(p, s)) == -1)) {
+	if (( followlinks && (i = stx_stat (p, s, m)) == -1) ||
+	    (!followlinks && (i = stx_lstat(p, s, m)) == -1)) {
 		if (!(mode & 1) && errno != ENOENT) {
 			printerr(strerror(errno), LOCFMT "stat \"%s\""
 			    LOCVAR, p);
@@ -15,7 +15,19 @@ PERFORMANCE OF THIS SOFTWARE.
 */
 
 #define GQBUFSIZ (1024 * 1024)
-#define GQBSEEK  (1024 * 4)
+/* Kept from a line which is longer than the buffer */
+#define GQBKEEP  (1024 * 4)
+/* Lines with the literal but without a match which are searched one by
+ * one */
+#define GQ_NWIN  16
+/* ms between two checks for '%' */
+#define GQ_TMO   20
+
+/* gq_job.op */
+#define GQ_OPEN   0
+#define GQ_READ   1
+#define GQ_CLOSE  2
+#define GQ_UNPACK 3
 
 #include <string.h>
 #include <stdlib.h>
@@ -26,22 +38,86 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <fcntl.h>
 #include <regex.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <signal.h>
 #include "compat.h"
 #include "diff.h"
 #include "main.h"
 #include "ui.h"
 #include "ui2.h"
 #include "gq.h"
+#include "lit.h"
+#include "pool.h"
+#include "gqi.h"
+#include "exec.h"
+#include "uzp.h"
+#include "zrd.h"
 
 struct gq_re {
 	regex_t re;
+	char *s; /* pattern and flags for the copies of the workers */
+	int fl;
+	struct lit lit;
 	struct gq_re *next;
 };
 
-static char *gq_buf;
+/* File of gq_add() */
+struct gq_job {
+	void *arg; /* NULL: Only a match in any file is needed */
+	char *pth; /* NULL: Not searched */
+	int r; /* 0: found, 1: not found, -1: error */
+	int err; /* errno for {r} = -1 */
+	int op; /* failed call */
+	const char *msg; /* error message for GQ_UNPACK */
+	int ix; /* tree for gqi_test(), -1: no index */
+	enum uz_id uz; /* decompressed with zrd_read() */
+};
+
+/* Per worker */
+struct gq_wrk {
+	char *buf;
+	char *fnd; /* Pattern is found in current file */
+	unsigned nfnd; /* size of {fnd} */
+	struct gqi_bld bld;
+	struct zrd *zr;
+	/* Own copies of the patterns in the order of gq_re, since
+	 * regexec() locks a regex_t.  If regcomp() fails, the patterns
+	 * from {nre} on use the regex_t of gq_re. */
+	regex_t *re;
+	unsigned nre;
+	bool rec; /* {re} is made */
+};
+
+static void gq_run(void *, unsigned);
+static void gq_res(void *, int);
+static void gq_recomp(struct gq_wrk *);
+static void gq_refree(void);
+static int gq_exec(struct gq_re *, regex_t *, char *, size_t, int);
+static int gq_rexec(regex_t *, char *, size_t, size_t, int);
+
 static struct gq_re *gq_re;
+static struct gq_job **gq_jobs;
+static size_t gq_njob, gq_jsiz;
+static struct pool *gq_pool;
+static bool gq_nopool;
+static struct gq_wrk *gq_wrk;
+static unsigned gq_nwrk;
+/* '%' had been typed */
+static volatile int gq_stop;
+/* A file which had been added with argument NULL contains the pattern */
+static volatile int gq_hit;
+static unsigned gq_nre;
+/* Hashed trigrams of the literals of all patterns, see gqi_test() */
+static uint32_t *gq_tri;
+static unsigned gq_ntri;
+static struct lit fn_lit;
 
 bool gq_pattern;
+/* MiB which are decompressed per file, 0: compressed files are searched
+ * as they are (RC file option) */
+unsigned long gq_zmax;
+/* Changed with each -F or -G pattern, see filt_chk() in db.c */
+unsigned gq_gen;
 static bool ign_errs;
 
 /* If called multiple times only the last pattern is applied */
@@ -55,6 +131,8 @@ fn_init(char *s)
 		fn_free();
 	}
 
+	gq_gen++;
+
 	fl = REG_NOSUB;
 
 	if (magic) {
@@ -70,11 +148,29 @@ fn_init(char *s)
 		return -1;
 	}
 
+	lit_mk(&fn_lit, s, fl);
 	file_pattern = TRUE;
 	find_name = TRUE;
 	return 0;
 }
 
+/* Matches file name {s} with the -F pattern.  The literal of the pattern
+ * is searched first.  Thread-safe.  0: Match */
+
+int
+fn_match(const char *s)
+{
+	if (fn_lit.l) {
+		if (lit_find(&fn_lit, s, strlen(s)) == LIT_NONE) {
+			return REG_NOMATCH;
+		} else if (fn_lit.all) {
+			return 0;
+		}
+	}
+
+	return regexec(&fn_re, s, 0, NULL, 0);
+}
+
 /* This function can be called multiple times with different patterns.
  * All these patterns are then AND combined. A OR combination can be
  * expressed with the regex operator | inside the pattern. */
@@ -85,6 +181,9 @@ gq_init(char *s)
 	int fl;
 	struct gq_re *re;
 
+	gq_gen++;
+	/* The index of the patterns changes */
+	gq_refree();
 	fl = REG_NOSUB | REG_NEWLINE;
 
 	if (magic)
@@ -93,16 +192,31 @@ gq_init(char *s)
 		fl |= REG_ICASE;
 
 	re = malloc(sizeof(struct gq_re));
-	re->next = gq_re;
-	gq_re = re;
+	memset(&re->lit, 0, sizeof re->lit);
 
 	if (regcomp(&re->re, s, fl)) {
 		printerr(strerror(errno), "regcomp \"%s\"", s);
+		free(re);
 		return -1;
 	}
 
-	if (!gq_buf) {
-		gq_buf = malloc(GQBUFSIZ + 1);
+	re->next = gq_re;
+	gq_re = re;
+	gq_nre++;
+
+	lit_mk(&re->lit, s, fl);
+	re->s = strdup(s);
+	re->fl = fl;
+
+	if (re->lit.l >= 3) {
+		size_t i;
+
+		gq_tri = realloc(gq_tri,
+		    (gq_ntri + re->lit.l - 2) * sizeof(uint32_t));
+
+		for (i = 0; i + 3 <= re->lit.l; i++) {
+			gq_tri[gq_ntri++] = gqi_tri(re->lit.s + i);
+		}
 	}
 
 	file_pattern = TRUE;
@@ -118,7 +232,9 @@ fn_free(void)
 	}
 
 	regfree(&fn_re);
+	lit_free(&fn_lit);
 	find_name = FALSE;
+	gq_gen++;
 
 	if (!gq_pattern) {
 		file_pattern = FALSE;
@@ -138,14 +254,23 @@ gq_free(void)
 		return 1;
 	}
 
+	gq_refree();
+
 	while (gq_re) {
 		p = gq_re->next;
 		regfree(&gq_re->re);
+		free(gq_re->s);
+		lit_free(&gq_re->lit);
 		free(gq_re);
 		gq_re = p;
 	}
 
+	gq_nre = 0;
+	free(gq_tri);
+	gq_tri = NULL;
+	gq_ntri = 0;
 	gq_pattern = FALSE;
+	gq_gen++;
 
 	if (!find_name) {
 		file_pattern = FALSE;
@@ -154,28 +279,39 @@ gq_free(void)
 	return 0;
 }
 
-int
-gq_proc(struct filediff *f)
+/* Content search in parallel:  gq_add() queues a file to the worker pool
+ * and gq_wait() waits for the queued files.  Each worker has its own
+ * buffer.  The results are merged by gq_wait() in the order of the
+ * gq_add() calls, so errors are reported and lists are filtered the same
+ * way as by a sequential search.  '%' stops the search. */
+
+void
+gq_add(struct filediff *f, void *arg)
 {
+	struct gq_job *j;
 	size_t l;
 	char *p;
-	ssize_t n;
-	int fh;
-	int rv = 1; /* not found */
-	struct gq_re *re;
+	unsigned n;
+	enum uz_id id;
 
-	if (dontcmp) {
-		return 0;
+	if (gq_njob == gq_jsiz) {
+		gq_jsiz = gq_jsiz ? gq_jsiz * 2 : 64;
+		gq_jobs = realloc(gq_jobs, gq_jsiz * sizeof(struct gq_job *));
 	}
 
-	if (getch() == '%') {
-		dontcmp = TRUE;
-		return 0;
+	j = malloc(sizeof(struct gq_job));
+	j->arg = arg;
+	j->pth = NULL;
+	j->r = 1; /* not found */
+	j->ix = -1;
+	j->uz = UZ_NONE;
+	gq_jobs[gq_njob++] = j;
+
+	if (dontcmp) {
+		j->r = 0;
+		return;
 	}
 
-#if defined(TRACE) && 0
-	fprintf(debug, "gq_proc(%s)", f->name);
-#endif
 	if (S_ISREG(f->type[0]) && f->siz[0]) {
 		p = syspth[0];
 		l = pthlen[0];
@@ -183,77 +319,449 @@ gq_proc(struct filediff *f)
 		p = syspth[1];
 		l = pthlen[1];
 	} else {
-		goto ret2; /* Not "ret" since p and l are not set */
+		return;
 	}
 
-	pthcat(p, l, f->name);
+	if (gq_zmax && zrd_can(id = uz_type(f->name))) {
+		j->uz = id;
+	}
+
+	/* The index contains the trigrams of the raw contents */
+	if (gqi_max && j->uz == UZ_NONE) {
+		j->ix = gqi_use(p == syspth[0] ? 0 : 1);
+	}
 
+	pthcat(p, l, f->name);
+	j->pth = strdup(p);
+	p[l] = 0;
 #if defined(TRACE) && 0
-	fprintf(debug, " \"%s\"", p);
+	fprintf(debug, "<>gq_add \"%s\"\n", j->pth);
 #endif
-	if ((fh = open(p, O_RDONLY)) == -1) {
 
-		if (!ign_errs && dialog(
-		    "'i' ignore errors, <other key> continue",
-		    NULL, "open \"%s\": %s", p, strerror(errno)) == 'i') {
+	if (!gq_pool && !gq_nopool) {
+		n = pool_nworkers();
+
+		if (!(gq_pool = pool_new(n))) {
+			gq_nopool = TRUE;
+			n = 1;
+		}
+
+		gq_wrk = calloc(n, sizeof(struct gq_wrk));
+		gq_nwrk = n;
+	}
+
+	if (gq_pool) {
+		pool_add(gq_pool, POOL_MAIN, gq_run, j);
+	} else {
+		gq_run(j, 0);
+	}
+}
+
+/* Returns the mark for gq_wait() before files are added.  gq_wait()
+ * only takes the files which had been added after the mark, so a caller
+ * does not depend on other pending searches, e.g. filt_gq() of
+ * diff_db_part(), which inc_poll() calls during build_diff_db(). */
+
+size_t
+gq_mark(void)
+{
+	return gq_njob;
+}
+
+/* Waits for the files of gq_add() since {mark}.  Calls {fn} for each file
+ * with the argument of gq_add() and the result (0: found, 1: not found,
+ * -1: error).  Files which had been added with argument NULL are skipped
+ * when the pattern had been found in any of them.  Returns 0 if the
+ * pattern is found in any file. */
+
+int
+gq_wait(size_t mark, void (*fn)(void *, int))
+{
+	struct gq_job *j;
+	size_t i;
+	int rv = 1;
+
+	if (gq_njob == mark) {
+		return 1;
+	}
+
+	/* Small batches are done before the first timeout */
+	do {
+		if (!gq_stop && getch() == '%') {
+			dontcmp = TRUE;
+			gq_stop = 1;
+		}
+	} while (gq_pool && pool_wait(gq_pool, GQ_TMO));
+
+	for (i = mark; i < gq_njob; i++) {
+		j = gq_jobs[i];
+
+		if (j->r == -1 && j->op == GQ_OPEN) {
+			if (!ign_errs && dialog(
+			    "'i' ignore errors, <other key> continue",
+			    NULL, "open \"%s\": %s", j->pth,
+			    strerror(j->err)) == 'i') {
+
+				ign_errs = TRUE;
+			}
+		} else if (j->r == -1) {
+			printerr(j->op == GQ_UNPACK ? j->msg :
+			    strerror(j->err), "%s \"%s\" failed",
+			    j->op == GQ_READ ? "read" :
+			    j->op == GQ_UNPACK ? "unpack" : "close", j->pth);
+		}
+
+		if (!j->r) {
+			rv = 0;
+		}
+
+		if (fn) {
+			fn(j->arg, j->r);
+		}
+
+		free(j->pth);
+		free(j);
+	}
+
+	gq_njob = mark;
+	gq_stop = 0;
+	gq_hit = 0;
+	return rv;
+}
+
+/* Searches one file synchronously.  0: Found, 1: Not found, -1: Error */
+
+int
+gq_proc(struct filediff *f)
+{
+	size_t m;
+	int r = 1;
+
+	m = gq_mark();
+	gq_add(f, &r);
+	gq_wait(m, gq_res);
+	return r;
+}
+
+static void
+gq_res(void *a, int r)
+{
+	*(int *)a = r;
+}
+
+/* Worker: All patterns are searched in one pass over the file.  Only
+ * complete lines are searched since the patterns are compiled with
+ * REG_NEWLINE.  The incomplete last line of a buffer is moved to the
+ * begin of the buffer and completed by the next read(), so nothing is
+ * read twice.  Each buffer is searched for all patterns which are not
+ * found yet, also if one of them is missing.  For patterns with a
+ * literal this is mostly the cost of lit_find(). */
+
+static void
+gq_run(void *a, unsigned w)
+{
+	struct gq_job *j = a;
+	struct gq_wrk *wk = &gq_wrk[w];
+	char *b;
+	ssize_t n;
+	int fh;
+	unsigned i;
+	struct gq_re *re;
+	/* Bytes kept in the buffer, end of the complete lines */
+	size_t k = 0, e;
+	/* Patterns which are not found yet */
+	unsigned nf;
+	/* Buffer starts inside a line */
+	bool nbol = FALSE;
+	bool eof = FALSE;
+	/* Trigrams are added to the index */
+	bool bld = FALSE;
+	int fl;
+	struct stat st;
+
+	if (!j->pth) {
+		return;
+	}
+
+	if (gq_stop) {
+		/* Like a disabled search */
+		j->r = 0;
+		return;
+	}
+
+	if (!j->arg && gq_hit) {
+		return;
+	}
+
+	if (!wk->buf) {
+		wk->buf = malloc(GQBUFSIZ + 1);
+	}
+
+	if (wk->nfnd < gq_nre) {
+		free(wk->fnd);
+		wk->fnd = malloc(wk->nfnd = gq_nre);
+	}
 
-			ign_errs = TRUE;
+	b = wk->buf;
+
+	if (!wk->rec) {
+		gq_recomp(wk);
+	}
+
+	if (j->ix >= 0 && stat(j->pth, &st) != -1) {
+		switch (gqi_test(j->ix, &st, gq_tri, gq_ntri)) {
+		case GQI_NO:
+			return; /* not found */
+		case GQI_NEW:
+			gqi_bld_ini(&wk->bld);
+			bld = TRUE;
+			break;
 		}
+	}
 
-		rv = -1;
-		goto ret;
+	if ((fh = open(j->pth, O_RDONLY)) == -1) {
+		j->err = errno;
+		j->op = GQ_OPEN;
+		j->r = -1;
+		return;
 	}
 
-	re = gq_re;
+	memset(wk->fnd, 0, gq_nre);
+	nf = gq_nre;
+
+	if (j->uz != UZ_NONE) {
+		if (!wk->zr) {
+			wk->zr = zrd_new();
+		}
+
+		zrd_open(wk->zr, fh, j->uz, (off_t)gq_zmax << 20);
+	}
 
 	while (1) {
-		if ((n = read(fh, gq_buf, GQBUFSIZ)) == -1) {
-			printerr(strerror(errno), "read \"%s\"", p);
-			rv = -1;
+		if (gq_stop) {
+			j->r = 0;
 			break;
 		}
 
-		if (!n)
+		if (!j->arg && gq_hit) {
 			break;
+		}
 
-		gq_buf[n] = 0;
+		if (j->uz != UZ_NONE) {
+			n = zrd_read(wk->zr, b + k, GQBUFSIZ - k);
+		} else {
+			n = read(fh, b + k, GQBUFSIZ - k);
+		}
 
-		if (!regexec(&re->re, gq_buf, 0, NULL, 0)) {
-			if (!(re = re->next)) {
-				rv = 0;
-				break;
+		if (n == -1) {
+			if (j->uz != UZ_NONE && (j->msg = zrd_err(wk->zr))) {
+				j->op = GQ_UNPACK;
 			} else {
-				if (lseek(fh, 0, SEEK_SET) == -1) {
-					printerr(strerror(errno),
-					    "lseek \"%s\"", p);
-					rv = -1;
-					break;
-				}
+				j->err = errno;
+				j->op = GQ_READ;
+			}
+
+			j->r = -1;
+			break;
+		}
+
+		eof = (size_t)n < GQBUFSIZ - k;
 
+		if (bld) {
+			gqi_bld_add(&wk->bld, b + k, n);
+		}
+
+		n += k;
+		fl = nbol ? REG_NOTBOL : 0;
+
+		if (eof) {
+			/* No empty line after the last '\n' */
+			e = n && b[n - 1] == '\n' ? n - 1 : n;
+		} else {
+			for (e = n; e && b[e - 1] != '\n'; e--);
+
+			if (e) {
+				e--; /* '\n' is not searched */
+			} else {
+				/* Line longer than buffer */
+				e = n;
+				fl |= REG_NOTEOL;
+			}
+		}
+
+		for (re = gq_re, i = 0; re; re = re->next, i++) {
+			if (wk->fnd[i]) {
 				continue;
 			}
+
+			if (!gq_exec(re, i < wk->nre ? &wk->re[i] : &re->re,
+			    b, e, fl)) {
+				wk->fnd[i] = 1;
+				nf--;
+			} else if (eof) {
+				/* Cannot match anymore */
+				break;
+			}
 		}
 
-		if (n != GQBUFSIZ)
+		if (!nf) {
+			j->r = 0;
+
+			if (!j->arg) {
+				gq_hit = 1;
+			}
+
 			break;
+		}
 
-		if (lseek(fh, -GQBSEEK, SEEK_CUR) == -1) {
-			printerr(strerror(errno), "lseek \"%s\" failed", p);
-			rv = -1;
+		if (eof)
 			break;
+
+		if (e < (size_t)n) {
+			k = n - e - 1;
+			memmove(b, b + e + 1, k);
+			nbol = FALSE;
+		} else {
+			k = GQBKEEP;
+			memmove(b, b + n - k, k);
+			nbol = TRUE;
 		}
 	}
 
-	if (close(fh) == -1) {
-		printerr(strerror(errno), "close \"%s\" failed", p);
-		rv = -1;
+	if (j->uz != UZ_NONE) {
+		zrd_close(wk->zr);
 	}
 
-ret:
-	p[l] = 0;
-ret2:
-#if defined(TRACE) && 0
-	fprintf(debug, "->(%d)\n", rv);
+	if (close(fh) == -1 && j->r != -1) {
+		j->err = errno;
+		j->op = GQ_CLOSE;
+		j->r = -1;
+	}
+
+	/* Only a completely read file can be indexed */
+	if (bld && eof && j->r != -1) {
+		gqi_put(j->ix, &st, &wk->bld);
+	}
+}
+
+/* Compiles the copies of the patterns for worker {wk} */
+
+static void
+gq_recomp(struct gq_wrk *wk)
+{
+	struct gq_re *re;
+
+	wk->re = malloc(gq_nre * sizeof(regex_t));
+
+	for (re = gq_re; re; re = re->next) {
+		if (regcomp(&wk->re[wk->nre], re->s, re->fl)) {
+			break;
+		}
+
+		wk->nre++;
+	}
+
+	wk->rec = TRUE;
+}
+
+/* Frees the copies of the patterns of all workers.  No search may run. */
+
+static void
+gq_refree(void)
+{
+	struct gq_wrk *wk;
+	unsigned w, i;
+
+	for (w = 0; w < gq_nwrk; w++) {
+		wk = &gq_wrk[w];
+
+		for (i = 0; i < wk->nre; i++) {
+			regfree(&wk->re[i]);
+		}
+
+		free(wk->re);
+		wk->re = NULL;
+		wk->nre = 0;
+		wk->rec = FALSE;
+	}
+}
+
+/* Searches the first {l} bytes of buffer {b}, which may contain NUL
+ * bytes, for pattern {re} compiled as {rx}.  If the pattern contains a
+ * literal, only the lines with the literal are searched.  After GQ_NWIN
+ * such lines without a match the rest of the buffer is searched at once.
+ * 0: Found */
+
+static int
+gq_exec(struct gq_re *re, regex_t *rx, char *b, size_t l, int fl)
+{
+	size_t o, s, e, i;
+	char *p;
+	unsigned w = 0;
+
+	if (!re->lit.l) {
+		return gq_rexec(rx, b, 0, l, fl);
+	}
+
+	for (o = 0; o < l; o = e + 1) {
+		if ((i = lit_find(&re->lit, b + o, l - o)) == LIT_NONE) {
+			break;
+		}
+
+		if (re->lit.all) {
+			return 0;
+		}
+
+		i += o;
+
+		for (s = i; s > o && b[s - 1] != '\n'; s--);
+
+		if (++w > GQ_NWIN) {
+			return gq_rexec(rx, b, s, l, s ? fl & ~REG_NOTBOL : fl);
+		}
+
+		e = (p = memchr(b + i, '\n', l - i)) ? (size_t)(p - b) : l;
+
+		if (!gq_rexec(rx, b, s, e, (s ? fl & ~REG_NOTBOL : fl) &
+		    (e < l ? ~REG_NOTEOL : ~0))) {
+			return 0;
+		}
+	}
+
+	return REG_NOMATCH;
+}
+
+/* regexec(3) for the bytes [{s}, {e}) of buffer {b}.  b[s - 1] is '\n'
+ * for {s} > 0. */
+
+static int
+gq_rexec(regex_t *rx, char *b, size_t s, size_t e, int fl)
+{
+#ifdef REG_STARTEND
+	regmatch_t m;
+
+	m.rm_so = s;
+	m.rm_eo = e;
+	return regexec(rx, b, 1, &m, fl | REG_STARTEND);
+#else
+	size_t i;
+	char c;
+	int r = REG_NOMATCH;
+
+	c = b[e];
+	b[e] = 0;
+
+	/* Each string between two NUL bytes is searched */
+	for (i = s; i <= e; i += strlen(b + i) + 1) {
+		if (!regexec(rx, b + i, 0, NULL, fl)) {
+			r = 0;
+			break;
+		}
+
+		fl |= REG_NOTBOL;
+	}
+
+	b[e] = c;
+	return r;
 #endif
-	return rv;
 }
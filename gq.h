@@ -1,7 +1,13 @@
 extern bool gq_pattern;
+extern unsigned long gq_zmax;
+extern unsigned gq_gen;
 
 int fn_init(char *);
+int fn_match(const char *);
 int gq_init(char *);
 int fn_free(void);
 int gq_free(void);
+void gq_add(struct filediff *, void *);
+size_t gq_mark(void);
+int gq_wait(size_t, void (*)(void *, int));
 int gq_proc(struct filediff *);
@@ -0,0 +1,683 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Trigram index of the files which are searched with -G.  For each file
+ * the set of the trigrams of its contents is stored as a bit map of
+ * hashed trigrams together with the file identity (device, inode, size,
+ * mtime).  A file which does not contain all trigrams of the literals
+ * of the patterns cannot match and is not opened.  Files which are not
+ * in the index or have changed are searched and added to the index when
+ * they had been read completely.
+ *
+ * There is one index per tree root in ~/.vddiffgqi/, named by the digest
+ * of the real path of the root.  It is read when it is used first and
+ * merged and written on exit like the digest cache.  ASCII letters are
+ * folded to lower case, so the index can be used for case-insensitive
+ * patterns as well.  Lookups and inserts are thread-safe. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <regex.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "compat.h"
+#include "ui.h"
+#include "main.h"
+#include "info.h"
+#include "dgst.h"
+#include "gqi.h"
+
+/* Bits of the map of hashed trigrams while a file is read.  The map is
+ * folded to 2^k bits with GQI_MIN <= k <= GQI_MAX for storing. */
+#define GQI_MAX  20
+#define GQI_BITS (1UL << GQI_MAX)
+#define GQI_MIN  9
+/* Stored maps have GQI_DENS bits per trigram, at most 1/GQI_DENS of the
+ * bits is set.  Files with more trigrams are not stored. */
+#define GQI_DENS 4
+#define GQI_NIL  ((uint32_t)-1)
+#define GQI_FOLD(c) ((c) >= 'A' && (c) <= 'Z' ? (c) | 0x20 : (c))
+
+struct gqi_hdr {
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t siz;
+	int64_t sec;
+	uint32_t nsec;
+	uint32_t use; /* LRU clock */
+	uint32_t k; /* map has 2^k bits */
+	uint32_t pad;
+};
+
+struct gqi_ent {
+	struct gqi_hdr h;
+	uint32_t *m;
+};
+
+/* Index of one tree root */
+struct gqi_db {
+	char *pth; /* NULL: No index */
+	char *tpth; /* .new */
+	char *lpth; /* .lck */
+	struct gqi_ent *v;
+	size_t num, vsiz;
+	/* Hash table of indices of {v}, size is a power of 2 */
+	uint32_t *tab;
+	size_t tsiz;
+	uint32_t clk;
+	size_t msiz; /* bytes of all maps */
+	bool load; /* had been read */
+	bool dirty;
+};
+
+static uint32_t gqi_hash(uint32_t);
+static void gqi_id(struct gqi_hdr *, struct stat *);
+static uint32_t *gqi_slot(struct gqi_db *, uint64_t, uint64_t);
+static void gqi_ins(struct gqi_db *, struct gqi_ent *);
+static void gqi_rehash(struct gqi_db *, size_t);
+static void gqi_evict(struct gqi_db *, size_t);
+static int gqi_ucmp(const void *, const void *);
+static int gqi_read(struct gqi_db *);
+static int gqi_write(struct gqi_db *);
+static char *gqi_dir(void);
+
+static const char gqi_magic[8] = "VDGQI1\n";
+static const char gqi_name[] = "." BIN "gqi";
+
+/* Maximum number of files per index, 0: index disabled (RC file
+ * option) */
+unsigned long gqi_max;
+static struct gqi_db gqi_db[2];
+/* Index of tree 0 and 1, they may be the same */
+static struct gqi_db *gqi_tree[2];
+static unsigned char gqi_fold[256];
+static unsigned long gqi_hits, gqi_miss, gqi_skip, gqi_nput;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t gqi_mtx = PTHREAD_MUTEX_INITIALIZER;
+# define GQI_LOCK() pthread_mutex_lock(&gqi_mtx)
+# define GQI_UNLOCK() pthread_mutex_unlock(&gqi_mtx)
+#else
+# define GQI_LOCK()
+# define GQI_UNLOCK()
+#endif
+
+/* Sets the index names for the tree roots on start.  {skip}: Bit 0 and
+ * 1 are set for a tree which is a temporary directory of an archive. */
+
+void
+gqi_ini(unsigned skip)
+{
+	struct dgst_st ds;
+	uint64_t h[2];
+	char *d, *r;
+	size_t l;
+	int i;
+
+	if (!gqi_max) {
+		return;
+	}
+
+	for (i = 0; i < 256; i++) {
+		gqi_fold[i] = GQI_FOLD(i);
+	}
+
+	if (!(d = gqi_dir())) {
+		gqi_max = 0;
+		return;
+	}
+
+	l = strlen(d);
+
+	for (i = 0; i < 2; i++) {
+		if (skip & (1 << i) || ((bmode || !*syspth[i]) && i)) {
+			continue;
+		}
+
+		if (!(r = realpath(syspth[i], NULL))) {
+			continue;
+		}
+
+		dgst_init(&ds);
+		dgst_upd(&ds, r, strlen(r));
+		dgst_fin(&ds, h);
+		free(r);
+		gqi_db[i].pth = malloc(l + 1 + 32 + 4 + 1);
+		snprintf(gqi_db[i].pth, l + 1 + 32 + 1, "%s/%016llx%016llx",
+		    d, (unsigned long long)h[0], (unsigned long long)h[1]);
+		gqi_tree[i] = gqi_db + i;
+
+		if (i && gqi_db[0].pth && !strcmp(gqi_db[0].pth,
+		    gqi_db[1].pth)) {
+			free(gqi_db[1].pth);
+			gqi_db[1].pth = NULL;
+			gqi_tree[1] = gqi_db;
+			continue;
+		}
+
+		gqi_db[i].tpth = malloc(l + 1 + 32 + 4 + 1);
+		gqi_db[i].lpth = malloc(l + 1 + 32 + 4 + 1);
+		sprintf(gqi_db[i].tpth, "%s.new", gqi_db[i].pth);
+		sprintf(gqi_db[i].lpth, "%s.lck", gqi_db[i].pth);
+	}
+
+	if (bmode) {
+		gqi_tree[1] = gqi_tree[0];
+	}
+
+	free(d);
+}
+
+/* Returns ~/.vddiffgqi, which is created if it does not exist */
+
+static char *
+gqi_dir(void)
+{
+	char *d;
+
+	if (!(d = add_home_pth(gqi_name))) {
+		return NULL;
+	}
+
+	if (mkdir(d, 0700) == -1 && errno != EEXIST) {
+		printerr(strerror(errno), "mkdir \"%s\"", d);
+		free(d);
+		return NULL;
+	}
+
+	return d;
+}
+
+/* Reads the index of tree {i} if it is used the first time.  Not
+ * thread-safe, called before the files are searched.  Returns {i}, -1 if
+ * there is no index for tree {i}. */
+
+int
+gqi_use(int i)
+{
+	struct gqi_db *x;
+	int lh;
+
+	if (!gqi_max || !(x = gqi_tree[i])) {
+		return -1;
+	}
+
+	if (!x->load) {
+		x->load = TRUE;
+
+		if ((lh = create_flock(x->lpth)) != -1) {
+			GQI_LOCK();
+			gqi_read(x);
+			gqi_evict(x, gqi_max);
+			GQI_UNLOCK();
+			remove_flock(lh);
+		}
+	}
+
+	return i;
+}
+
+static uint32_t
+gqi_hash(uint32_t t)
+{
+	t *= 0x9e3779b1;
+	return (t ^ t >> 15) & (GQI_BITS - 1);
+}
+
+/* Hashed trigram of the first three bytes of {s} for gqi_test().  May
+ * be called before gqi_ini(). */
+
+uint32_t
+gqi_tri(const unsigned char *s)
+{
+	uint32_t t = 0;
+	int i;
+
+	for (i = 0; i < 3; i++) {
+		t = t << 8 | GQI_FOLD(s[i]);
+	}
+
+	return gqi_hash(t);
+}
+
+/* Looks up the file with stat data {st} in the index of tree {i}.
+ * {q}: {n} hashed trigrams which a file must contain to match.
+ * GQI_NO: The file does not contain all trigrams.  GQI_MAYBE: It
+ * contains all trigrams.  GQI_NEW: Not in the index or changed. */
+
+int
+gqi_test(int i, struct stat *st, const uint32_t *q, unsigned n)
+{
+	struct gqi_db *x = gqi_tree[i];
+	struct gqi_hdr e;
+	struct gqi_ent *p;
+	uint32_t *t, m;
+	int r = GQI_NEW;
+
+	gqi_id(&e, st);
+	GQI_LOCK();
+
+	if (!x->tab || *(t = gqi_slot(x, e.dev, e.ino)) == GQI_NIL) {
+		goto miss;
+	}
+
+	p = x->v + *t;
+
+	if (p->h.siz != e.siz || p->h.sec != e.sec || p->h.nsec != e.nsec) {
+		goto miss;
+	}
+
+	p->h.use = ++x->clk;
+	gqi_hits++;
+	r = GQI_MAYBE;
+	m = (1UL << p->h.k) - 1;
+
+	while (n--) {
+		if (!(p->m[(q[n] & m) >> 5] & 1UL << (q[n] & 31))) {
+			gqi_skip++;
+			r = GQI_NO;
+			break;
+		}
+	}
+
+	goto unlock;
+
+miss:
+	gqi_miss++;
+unlock:
+	GQI_UNLOCK();
+	return r;
+}
+
+/* Starts a file.  The map is cleared by gqi_put() or here. */
+
+void
+gqi_bld_ini(struct gqi_bld *b)
+{
+	if (!b->map) {
+		b->map = calloc(GQI_BITS / 32, sizeof(uint32_t));
+		b->wv = malloc(GQI_BITS / 32 * sizeof(uint32_t));
+	}
+
+	while (b->nw) {
+		b->map[b->wv[--b->nw]] = 0;
+	}
+
+	b->cnt = 0;
+	b->t = 0;
+	b->n = 0;
+}
+
+/* Adds the next {l} bytes of the file */
+
+void
+gqi_bld_add(struct gqi_bld *b, const void *s, size_t l)
+{
+	const unsigned char *p = s, *e = p + l;
+	uint32_t t = b->t, h, *w;
+
+	for (; b->n < 2 && p < e; b->n++) {
+		t = t << 8 | gqi_fold[*p++];
+	}
+
+	for (; p < e; p++) {
+		t = (t << 8 | gqi_fold[*p]) & 0xffffff;
+		h = gqi_hash(t);
+		w = b->map + (h >> 5);
+
+		if (!(*w & 1UL << (h & 31))) {
+			if (!*w) {
+				b->wv[b->nw++] = h >> 5;
+			}
+
+			*w |= 1UL << (h & 31);
+			b->cnt++;
+		}
+	}
+
+	b->t = t;
+}
+
+/* Stores the trigrams {b} of the file with stat data {st} in the index
+ * of tree {i} and clears {b} */
+
+void
+gqi_put(int i, struct stat *st, struct gqi_bld *b)
+{
+	struct gqi_db *x = gqi_tree[i];
+	struct gqi_ent e;
+	uint32_t m;
+	unsigned k;
+
+	if (b->cnt > GQI_BITS / GQI_DENS) {
+		gqi_bld_ini(b); /* would not rule out much */
+		return;
+	}
+
+	for (k = GQI_MIN; (1UL << k) < GQI_DENS * b->cnt; k++);
+
+	gqi_id(&e.h, st);
+	e.h.k = k;
+	e.m = calloc((1UL << k) / 32, sizeof(uint32_t));
+	m = (1UL << (k - 5)) - 1;
+
+	while (b->nw) {
+		uint32_t j = b->wv[--b->nw];
+
+		e.m[j & m] |= b->map[j];
+		b->map[j] = 0;
+	}
+
+	GQI_LOCK();
+	e.h.use = ++x->clk;
+	gqi_ins(x, &e);
+	x->dirty = TRUE;
+	gqi_nput++;
+
+	if (x->num > gqi_max + gqi_max / 8) {
+		gqi_evict(x, gqi_max);
+	}
+
+	GQI_UNLOCK();
+}
+
+static void
+gqi_id(struct gqi_hdr *e, struct stat *st)
+{
+	memset(e, 0, sizeof(struct gqi_hdr));
+	e->dev = st->st_dev;
+	e->ino = st->st_ino;
+	e->siz = st->st_size;
+	e->sec = st->st_mtim.tv_sec;
+	e->nsec = st->st_mtim.tv_nsec;
+}
+
+/* Slot of (dev, ino) in the hash table, GQI_NIL if not found */
+
+static uint32_t *
+gqi_slot(struct gqi_db *x, uint64_t dev, uint64_t ino)
+{
+	size_t i, m = x->tsiz - 1;
+	struct gqi_ent *p;
+
+	i = (uint32_t)gqi_hash((uint32_t)(ino ^ ino >> 32 ^ dev)) & m;
+
+	while (x->tab[i] != GQI_NIL) {
+		p = x->v + x->tab[i];
+
+		if (p->h.ino == ino && p->h.dev == dev) {
+			break;
+		}
+
+		i = (i + 1) & m;
+	}
+
+	return x->tab + i;
+}
+
+/* Inserts or replaces the entry for {e}.  Locked by caller. */
+
+static void
+gqi_ins(struct gqi_db *x, struct gqi_ent *e)
+{
+	uint32_t *t;
+
+	if (2 * (x->num + 1) > x->tsiz) {
+		gqi_rehash(x, x->tsiz ? 2 * x->tsiz : 1024);
+	}
+
+	x->msiz += (1UL << e->h.k) / 8;
+
+	if (*(t = gqi_slot(x, e->h.dev, e->h.ino)) != GQI_NIL) {
+		x->msiz -= (1UL << x->v[*t].h.k) / 8;
+		free(x->v[*t].m);
+		x->v[*t] = *e;
+		return;
+	}
+
+	if (x->num == x->vsiz) {
+		x->vsiz = x->vsiz ? 2 * x->vsiz : 512;
+		x->v = realloc(x->v, x->vsiz * sizeof(struct gqi_ent));
+	}
+
+	*t = x->num;
+	x->v[x->num++] = *e;
+}
+
+static void
+gqi_rehash(struct gqi_db *x, size_t n)
+{
+	size_t i;
+
+	free(x->tab);
+	x->tsiz = n;
+	x->tab = malloc(n * sizeof(uint32_t));
+	memset(x->tab, 0xff, n * sizeof(uint32_t));
+
+	for (i = 0; i < x->num; i++) {
+		*gqi_slot(x, x->v[i].h.dev, x->v[i].h.ino) = i;
+	}
+}
+
+/* Keeps the {n} most recently used entries */
+
+static void
+gqi_evict(struct gqi_db *x, size_t n)
+{
+	size_t i;
+
+	if (x->num <= n) {
+		return;
+	}
+
+	qsort(x->v, x->num, sizeof(struct gqi_ent), gqi_ucmp);
+
+	for (i = n; i < x->num; i++) {
+		x->msiz -= (1UL << x->v[i].h.k) / 8;
+		free(x->v[i].m);
+	}
+
+	x->num = n;
+	gqi_rehash(x, x->tsiz);
+}
+
+/* Most recently used first */
+
+static int
+gqi_ucmp(const void *a, const void *b)
+{
+	const struct gqi_ent *x = a, *y = b;
+
+	return x->h.use > y->h.use ? -1 : x->h.use < y->h.use ? 1 : 0;
+}
+
+/* Reads the index file after the entries in memory.  Entries for inodes
+ * which are already in memory are ignored.  Locked by caller.
+ * -1: Error, 0: OK */
+
+static int
+gqi_read(struct gqi_db *x)
+{
+	FILE *fh;
+	char m[sizeof gqi_magic];
+	struct gqi_ent e;
+	size_t l;
+	int rv = 0;
+
+	if (!(fh = fopen(x->pth, "r"))) {
+		if (errno == ENOENT) {
+			return 0;
+		}
+
+		printerr(strerror(errno), "fopen \"%s\"", x->pth);
+		return -1;
+	}
+
+	if (fread(m, sizeof m, 1, fh) != 1 ||
+	    memcmp(m, gqi_magic, sizeof m)) {
+		/* Other version or empty, is overwritten */
+		goto close;
+	}
+
+	if (!x->tsiz) {
+		gqi_rehash(x, 1024);
+	}
+
+	while (fread(&e.h, sizeof e.h, 1, fh) == 1) {
+		if (e.h.k < GQI_MIN || e.h.k > GQI_MAX) {
+			break; /* truncated by a crash */
+		}
+
+		l = (1UL << e.h.k) / 8;
+		e.m = malloc(l);
+
+		if (fread(e.m, l, 1, fh) != 1) {
+			free(e.m);
+			break;
+		}
+
+		if (*gqi_slot(x, e.h.dev, e.h.ino) == GQI_NIL) {
+			gqi_ins(x, &e);
+		} else {
+			free(e.m);
+		}
+
+		if (e.h.use > x->clk) {
+			x->clk = e.h.use;
+		}
+	}
+
+	if (ferror(fh)) {
+		printerr(strerror(errno), "fread \"%s\"", x->pth);
+		rv = -1;
+	}
+
+close:
+	fclose(fh);
+	return rv;
+}
+
+/* Merges the index file with the new entries and writes it */
+
+static int
+gqi_write(struct gqi_db *x)
+{
+	FILE *fh;
+	size_t i;
+
+	if (gqi_read(x)) {
+		return -1;
+	}
+
+	gqi_evict(x, gqi_max);
+
+	if (!(fh = fopen(x->tpth, "w"))) {
+		printerr(strerror(errno), "fopen \"%s\"", x->tpth);
+		return -1;
+	}
+
+	if (fwrite(gqi_magic, sizeof gqi_magic, 1, fh) != 1) {
+		goto err;
+	}
+
+	for (i = 0; i < x->num; i++) {
+		if (fwrite(&x->v[i].h, sizeof x->v[i].h, 1, fh) != 1 ||
+		    fwrite(x->v[i].m, (1UL << x->v[i].h.k) / 8, 1, fh) != 1) {
+			goto err;
+		}
+	}
+
+	if (fclose(fh) == EOF) {
+		printerr(strerror(errno), "fclose \"%s\"", x->tpth);
+		unlink(x->tpth);
+		return -1;
+	}
+
+	if (rename(x->tpth, x->pth) == -1) {
+		printerr(strerror(errno), "rename \"%s\", \"%s\"",
+		    x->tpth, x->pth);
+		return -1;
+	}
+
+	x->dirty = FALSE;
+	return 0;
+
+err:
+	printerr(strerror(errno), "fwrite \"%s\"", x->tpth);
+	fclose(fh);
+	unlink(x->tpth);
+	return -1;
+}
+
+/* Writes the changed indices on exit */
+
+void
+gqi_save(void)
+{
+	struct gqi_db *x;
+	int i, lh;
+
+	for (i = 0; i < 2; i++) {
+		x = gqi_db + i;
+
+		if (!gqi_max || !x->pth || !x->dirty) {
+			continue;
+		}
+
+		if ((lh = create_flock(x->lpth)) == -1) {
+			continue;
+		}
+
+		GQI_LOCK();
+		gqi_write(x);
+		GQI_UNLOCK();
+		remove_flock(lh);
+	}
+}
+
+/* Shows the statistics in the status line */
+
+void
+gqi_stat(void)
+{
+	size_t n = 0, s = 0;
+	int i;
+
+	if (!gqi_max) {
+		printerr(NULL, "Grep index is disabled");
+		return;
+	}
+
+	GQI_LOCK();
+
+	for (i = 0; i < 2; i++) {
+		n += gqi_db[i].num;
+		s += gqi_db[i].msiz;
+	}
+
+	printerr(NULL, "Grep index: %lu files, %lu KiB, %lu hits, "
+	    "%lu ruled out, %lu misses, %lu added", (unsigned long)n,
+	    (unsigned long)(s / 1024), gqi_hits, gqi_skip, gqi_miss,
+	    gqi_nput);
+	GQI_UNLOCK();
+}
@@ -0,0 +1,26 @@
+/* Trigrams of a file which is read, see gqi_bld_add() */
+struct gqi_bld {
+	uint32_t *map; /* GQI_BITS bits */
+	uint32_t *wv; /* indices of the words of {map} which are not 0 */
+	unsigned nw;
+	unsigned long cnt; /* bits set in {map} */
+	uint32_t t; /* last two bytes */
+	unsigned n; /* number of bytes, up to 2 */
+};
+
+/* gqi_test() */
+#define GQI_NO    0
+#define GQI_MAYBE 1
+#define GQI_NEW   2
+
+extern unsigned long gqi_max;
+
+void gqi_ini(unsigned);
+int gqi_use(int);
+uint32_t gqi_tri(const unsigned char *);
+int gqi_test(int, struct stat *, const uint32_t *, unsigned);
+void gqi_bld_ini(struct gqi_bld *);
+void gqi_bld_add(struct gqi_bld *, const void *, size_t);
+void gqi_put(int, struct stat *, struct gqi_bld *);
+void gqi_save(void);
+void gqi_stat(void);
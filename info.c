@@ -37,9 +37,7 @@ static void info_wait(void);
 static int info_proc(void);
 static void info_wr_bdl(FILE *);
 static void info_wr_ddl(FILE *);
-static int create_flock(char *);
 static int wait_flock(char *);
-static void remove_flock(int);
 
 static const char info_name[] = "." BIN "info.new";
 const char info_dir_txt[] = "dir";
@@ -120,7 +118,9 @@ ret:
 	return;
 }
 
-static int
+/* Also used for the digest cache file */
+
+int
 create_flock(char *fnam)
 {
 	int fh;
@@ -203,7 +203,7 @@ close:
 	return r;
 }
 
-static void
+void
 remove_flock(int fh)
 {
 	struct flock fl;
@@ -2,6 +2,8 @@ void info_load(void);
 void info_store(void);
 void info_chomp(char *);
 int stat_info_pth(void);
+int create_flock(char *);
+void remove_flock(int);
 
 extern const char info_dir_txt[];
 extern const char info_ddir_txt[];
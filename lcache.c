@@ -0,0 +1,328 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Cache of directory listings in diff mode.  When a directory is left, its
+ * listing (the data of diff_db_store()) is kept, so entering it again needs
+ * no directory read and no compare.  A listing is identified by device and
+ * inode of its directories.  It is only used if the modification and
+ * change times of the directories are unchanged.  The memory of all
+ * listings is limited, the least recently used ones are removed first. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "diff.h"
+#include "main.h"
+#include "ui.h"
+#include "ui2.h"
+#include "exec.h"
+#include "uzp.h"
+#include "db.h"
+#include "tc.h"
+#include "arena.h"
+#include "lcache.h"
+
+/* Identity of the directories of a listing */
+
+struct lc_key {
+	dev_t dev[2];
+	ino_t ino[2];
+	struct timespec mtim[2], ctim[2];
+	short tree; /* 1: left, 2: right, 3: both */
+};
+
+struct lc_ent {
+	struct lc_ent *prev, *next; /* LRU list, most recent first */
+	struct lc_ent *hnext;
+	struct lc_key key;
+	struct ui_state st;
+	size_t siz;
+};
+
+#define LC_HASH 256
+
+static struct lc_key *lc_mk_key(int);
+static struct lc_ent **lc_bucket(struct lc_key *);
+static struct lc_ent **lc_slot(struct lc_key *);
+static void lc_unlink(struct lc_ent *);
+static void lc_free(struct lc_ent *);
+
+/* Memory limit in MiB, 0: cache disabled (RC file option) */
+unsigned long lc_max;
+/* Key of the displayed listing, NULL: Don't cache it */
+static struct lc_key *lc_cur;
+static struct lc_ent *lc_tab[LC_HASH];
+static struct lc_ent *lc_head, *lc_tail;
+static size_t lc_num, lc_siz;
+static unsigned long lc_hits, lc_miss, lc_stale, lc_nevict;
+
+/* Called instead of build_diff_db({tree}) in diff mode.  Returns 1 if the
+ * listing has been taken from the cache.  Else the key of the listing
+ * which is built now is remembered for lc_save(). */
+
+int
+lc_load(int tree)
+{
+	struct lc_key *k;
+	struct lc_ent *e, **p;
+
+	lc_drop();
+
+	if (!lc_max || one_scan || !(k = lc_mk_key(tree))) {
+		return 0;
+	}
+
+	if (!(e = *(p = lc_slot(k)))) {
+		lc_miss++;
+		lc_cur = k;
+		return 0;
+	}
+
+	*p = e->hnext;
+	lc_unlink(e);
+
+	if (memcmp(e->key.mtim, k->mtim, sizeof k->mtim) ||
+	    memcmp(e->key.ctim, k->ctim, sizeof k->ctim)) {
+		lc_stale++;
+		lc_miss++;
+		lc_free(e);
+		lc_cur = k;
+		return 0;
+	}
+
+	lc_hits++;
+	/* Calls lc_drop() */
+	diff_db_restore(&e->st);
+	lc_cur = k;
+	free(e);
+	diff_db_sort(0);
+	return 1;
+}
+
+/* For a listing which is built again, e.g. after a file operation */
+
+void
+lc_new(int tree)
+{
+	lc_drop();
+
+	if (lc_max) {
+		lc_cur = lc_mk_key(tree);
+	}
+}
+
+/* Moves the displayed listing into the cache.  Called before it is
+ * replaced by the listing of the parent directory. */
+
+void
+lc_save(void)
+{
+	struct lc_ent *e, *o, **p;
+
+	if (!lc_cur || bmode || fmode || diff_db_pend()) {
+		lc_drop();
+		return;
+	}
+
+	e = malloc(sizeof(struct lc_ent));
+	e->key = *lc_cur;
+	lc_drop();
+	diff_db_store(&e->st);
+	e->siz = sizeof(struct lc_ent) + e->st.arena->tot +
+	    e->st.tot * sizeof(struct filediff *) * (e->st.list ? 2 : 1);
+
+	/* Replaces an old listing of the same directories */
+	if ((o = *(p = lc_slot(&e->key)))) {
+		*p = o->hnext;
+		lc_unlink(o);
+		lc_free(o);
+	}
+
+	p = lc_bucket(&e->key);
+	e->hnext = *p;
+	*p = e;
+	e->prev = NULL;
+
+	if ((e->next = lc_head)) {
+		lc_head->prev = e;
+	} else {
+		lc_tail = e;
+	}
+
+	lc_head = e;
+	lc_num++;
+	lc_siz += e->siz;
+
+	while (lc_tail && lc_siz > lc_max * 1024 * 1024) {
+		e = lc_tail;
+		*lc_slot(&e->key) = e->hnext;
+		lc_unlink(e);
+		lc_free(e);
+		lc_nevict++;
+	}
+}
+
+/* The displayed listing is not cached when it is left */
+
+void
+lc_drop(void)
+{
+	free(lc_cur);
+	lc_cur = NULL;
+}
+
+/* For the directory stack: Takes the key of the displayed listing */
+
+struct lc_key *
+lc_take(void)
+{
+	struct lc_key *k = lc_cur;
+
+	lc_cur = NULL;
+	return k;
+}
+
+/* For the directory stack: {k} is the key of the restored listing */
+
+void
+lc_give(struct lc_key *k)
+{
+	lc_drop();
+	lc_cur = k;
+}
+
+/* Removes all listings, e.g. after options had been changed */
+
+void
+lc_flush(void)
+{
+	struct lc_ent *e;
+
+	while ((e = lc_head)) {
+		lc_unlink(e);
+		lc_free(e);
+	}
+
+	memset(lc_tab, 0, sizeof lc_tab);
+}
+
+/* Shows the statistics in the status line */
+
+void
+lc_stat(void)
+{
+	if (!lc_max) {
+		printerr(NULL, "List cache is disabled");
+		return;
+	}
+
+	printerr(NULL, "List cache: %lu listings, %lu/%lu KiB, %lu hits, "
+	    "%lu misses (%lu changed), %lu evicted", (unsigned long)lc_num,
+	    (unsigned long)(lc_siz / 1024), lc_max * 1024, lc_hits, lc_miss,
+	    lc_stale, lc_nevict);
+}
+
+static struct lc_key *
+lc_mk_key(int tree)
+{
+	struct lc_key *k;
+	struct stat st;
+	int i;
+
+	k = calloc(1, sizeof(struct lc_key));
+	k->tree = tree;
+
+	for (i = 0; i < 2; i++) {
+		if (!(tree & (1 << i))) {
+			continue;
+		}
+
+		syspth[i][pthlen[i]] = 0;
+
+		if (stat(syspth[i], &st) == -1) {
+			free(k);
+			return NULL;
+		}
+
+		k->dev[i] = st.st_dev;
+		k->ino[i] = st.st_ino;
+		k->mtim[i] = st.st_mtim;
+		k->ctim[i] = st.st_ctim;
+	}
+
+	return k;
+}
+
+static struct lc_ent **
+lc_bucket(struct lc_key *k)
+{
+	unsigned long h;
+
+	h = (unsigned long)k->ino[0] * 31 + (unsigned long)k->ino[1] +
+	    (unsigned long)k->dev[0] + (unsigned long)k->dev[1];
+	return &lc_tab[h % LC_HASH];
+}
+
+/* Returns the link to the entry with the directories of {k} or to the
+ * end of its bucket */
+
+static struct lc_ent **
+lc_slot(struct lc_key *k)
+{
+	struct lc_ent **p;
+
+	p = lc_bucket(k);
+
+	while (*p && ((*p)->key.tree != k->tree ||
+	    (*p)->key.ino[0] != k->ino[0] || (*p)->key.ino[1] != k->ino[1] ||
+	    (*p)->key.dev[0] != k->dev[0] || (*p)->key.dev[1] != k->dev[1])) {
+		p = &(*p)->hnext;
+	}
+
+	return p;
+}
+
+/* Removes {e} from the LRU list.  The hash table is not changed. */
+
+static void
+lc_unlink(struct lc_ent *e)
+{
+	if (e->prev) {
+		e->prev->next = e->next;
+	} else {
+		lc_head = e->next;
+	}
+
+	if (e->next) {
+		e->next->prev = e->prev;
+	} else {
+		lc_tail = e->prev;
+	}
+
+	lc_num--;
+	lc_siz -= e->siz;
+}
+
+static void
+lc_free(struct lc_ent *e)
+{
+	diff_db_st_free(&e->st);
+	free(e);
+}
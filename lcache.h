@@ -0,0 +1,12 @@
+struct lc_key;
+
+extern unsigned long lc_max;
+
+int lc_load(int);
+void lc_new(int);
+void lc_save(void);
+void lc_drop(void);
+struct lc_key *lc_take(void);
+void lc_give(struct lc_key *);
+void lc_flush(void);
+void lc_stat(void);
@@ -0,0 +1,432 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Literal prefilter for regular expressions.  lit_mk() takes the longest
+ * literal string which every match of a pattern contains.  lit_find()
+ * searches it with a vector kernel which compares the first and the last
+ * byte of the literal at 16 or 32 positions at once.  Only the candidates
+ * are compared completely.  regexec(3) is then needed only where the
+ * literal is found, and not at all if the pattern is the literal itself.
+ *
+ * If the case is ignored, the literal is kept in lower case and bit 0x20
+ * is set in each compared byte at letter positions.  Only ASCII is taken
+ * into the literal in this case.  'i', 'k' and 's' are not taken since in
+ * Unicode they also match non-ASCII letters (U+0131, U+212A, U+017F).
+ * Thread-safe after the first lit_mk(). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+# ifdef __SSE2__
+#  define LIT_SSE2
+# endif
+# ifdef HAVE_AVX2
+#  define LIT_AVX2
+# endif
+# if defined(LIT_SSE2) || defined(LIT_AVX2)
+#  include <immintrin.h>
+# endif
+#endif
+#include "compat.h"
+#include "lit.h"
+
+/* Token classes of lit_mk() */
+#define LT_CHR   0 /* literal character */
+#define LT_BRK   1 /* any other single element, ends the literal */
+#define LT_QUANT 2 /* quantifier, previous element is optional */
+#define LT_ALT   3 /* alternation */
+#define LT_OPEN  4 /* group */
+#define LT_CLOSE 5
+
+static const char *lit_tok(const char *, int, int *, int *);
+static int lit_cmp(const struct lit *, const unsigned char *);
+static size_t lit_scal(const struct lit *, const unsigned char *, size_t);
+#ifdef LIT_SSE2
+static size_t lit_sse2(const struct lit *, const unsigned char *, size_t);
+#endif
+#ifdef LIT_AVX2
+static size_t lit_avx2(const struct lit *, const unsigned char *, size_t);
+#endif
+
+static size_t (*lit_kern)(const struct lit *, const unsigned char *,
+    size_t);
+
+/* {fl}: Flags of regcomp(3).  t->l is 0 if no literal is found. */
+
+void
+lit_mk(struct lit *t, const char *s, int fl)
+{
+	const char *p;
+	unsigned char *r;
+	size_t n = 0, i;
+	int c, k, lvl = 0;
+	bool ic, end;
+
+	if (!lit_kern) {
+		lit_kern = lit_scal;
+#ifdef LIT_SSE2
+		lit_kern = lit_sse2;
+#endif
+#ifdef LIT_AVX2
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx2")) {
+			lit_kern = lit_avx2;
+		}
+#endif
+	}
+
+	memset(t, 0, sizeof *t);
+	ic = fl & REG_ICASE ? TRUE : FALSE;
+	t->all = TRUE;
+	/* Current run of literal characters */
+	r = malloc(strlen(s) + 1);
+
+	for (p = s; ; ) {
+		if ((end = !*p)) {
+			k = LT_BRK;
+		} else {
+			p = lit_tok(p, fl & REG_EXTENDED, &k, &c);
+		}
+
+		if (k == LT_CHR && (c >= 0x80 || c == '\n' ||
+		    (ic && strchr("iIkKsS", c)))) {
+			k = LT_BRK;
+		}
+
+		if (k == LT_CHR) {
+			if (lvl) {
+				/* Group may be optional */
+				t->all = FALSE;
+			} else {
+				r[n++] = ic && c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+			}
+
+			continue;
+		}
+
+		if (!end) {
+			t->all = FALSE;
+		}
+
+		if (k == LT_QUANT && n) {
+			n--;
+		}
+
+		if (n > t->l) {
+			free(t->s);
+			t->s = malloc(n);
+			memcpy(t->s, r, n);
+			t->l = n;
+		}
+
+		n = 0;
+
+		if (end) {
+			break;
+		} else if (k == LT_OPEN) {
+			lvl++;
+		} else if (k == LT_CLOSE && lvl) {
+			lvl--;
+		} else if (k == LT_ALT && !lvl) {
+			/* No common literal */
+			free(t->s);
+			t->s = NULL;
+			t->l = 0;
+			break;
+		}
+	}
+
+	free(r);
+
+	/* A single character is too frequent to save a regexec() */
+	if (!t->l || (t->l < 2 && !t->all)) {
+		free(t->s);
+		memset(t, 0, sizeof *t);
+		return;
+	}
+
+	t->msk = malloc(t->l);
+
+	for (i = 0; i < t->l; i++) {
+		t->msk[i] = ic && t->s[i] >= 'a' && t->s[i] <= 'z' ? 0x20 : 0;
+	}
+}
+
+void
+lit_free(struct lit *t)
+{
+	free(t->s);
+	free(t->msk);
+	memset(t, 0, sizeof *t);
+}
+
+/* Returns the offset of the literal in {b}, LIT_NONE if not found */
+
+size_t
+lit_find(const struct lit *t, const void *b, size_t n)
+{
+	if (n < t->l) {
+		return LIT_NONE;
+	}
+
+	return lit_kern(t, b, n);
+}
+
+/* Reads one element of pattern {p}.  {ere}: Extended syntax.  Sets the
+ * token class {k} and for LT_CHR the character {c}.  Returns the position
+ * after the element. */
+
+static const char *
+lit_tok(const char *p, int ere, int *k, int *c)
+{
+	int d;
+
+	*c = (unsigned char)*p++;
+	*k = LT_CHR;
+
+	switch (*c) {
+	case '.':
+	case '^':
+	case '$':
+		*k = LT_BRK;
+		break;
+	case '[':
+		*k = LT_BRK;
+
+		if (*p == '^')
+			p++;
+
+		if (*p == ']')
+			p++;
+
+		while (*p && *p != ']') {
+			if (*p == '[' && (p[1] == ':' || p[1] == '=' ||
+			    p[1] == '.')) {
+				d = p[1];
+
+				for (p += 2; *p && !(*p == d && p[1] == ']');
+				    p++);
+
+				if (*p)
+					p += 2;
+			} else {
+				p++;
+			}
+		}
+
+		if (*p)
+			p++;
+
+		break;
+	case '*':
+		*k = LT_QUANT;
+		break;
+	case '\\':
+		if (!*p) {
+			*k = LT_BRK;
+			break;
+		}
+
+		*c = (unsigned char)*p++;
+
+		if (strchr(".[]\\*^$", *c) || (ere && strchr("+?(){}|", *c))) {
+			break;
+		} else if (ere) {
+			/* \w, \<, back-references etc. */
+			*k = LT_BRK;
+			break;
+		}
+
+		switch (*c) {
+		case '(':
+			*k = LT_OPEN;
+			break;
+		case ')':
+			*k = LT_CLOSE;
+			break;
+		case '|':
+			*k = LT_ALT;
+			break;
+		case '+':
+		case '?':
+			*k = LT_QUANT;
+			break;
+		case '{':
+			*k = LT_QUANT;
+
+			for (; *p && !(*p == '\\' && p[1] == '}'); p++);
+
+			if (*p)
+				p += 2;
+
+			break;
+		default:
+			*k = LT_BRK;
+		}
+
+		break;
+	default:
+		/* In basic syntax these are literal characters */
+		if (!ere) {
+			break;
+		}
+
+		switch (*c) {
+		case '+':
+		case '?':
+			*k = LT_QUANT;
+			break;
+		case '{':
+			*k = LT_QUANT;
+
+			for (; *p && *p != '}'; p++);
+
+			if (*p)
+				p++;
+
+			break;
+		case '|':
+			*k = LT_ALT;
+			break;
+		case '(':
+			*k = LT_OPEN;
+			break;
+		case ')':
+			*k = LT_CLOSE;
+			break;
+		}
+	}
+
+	return p;
+}
+
+/* 0: Literal at {p} */
+
+static int
+lit_cmp(const struct lit *t, const unsigned char *p)
+{
+	size_t i;
+
+	for (i = 0; i < t->l; i++) {
+		if ((p[i] | t->msk[i]) != t->s[i]) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static size_t
+lit_scal(const struct lit *t, const unsigned char *b, size_t n)
+{
+	const unsigned char *p, *e;
+	unsigned c, m;
+
+	if (n < t->l) {
+		return LIT_NONE;
+	}
+
+	e = b + n - t->l + 1;
+	c = t->s[0];
+	m = t->msk[0];
+
+	if (!m) {
+		for (p = b; (p = memchr(p, c, e - p)); p++) {
+			if (!lit_cmp(t, p)) {
+				return p - b;
+			}
+		}
+
+		return LIT_NONE;
+	}
+
+	for (p = b; p < e; p++) {
+		if ((*p | m) == c && !lit_cmp(t, p)) {
+			return p - b;
+		}
+	}
+
+	return LIT_NONE;
+}
+
+#ifdef LIT_SSE2
+static size_t
+lit_sse2(const struct lit *t, const unsigned char *b, size_t n)
+{
+	size_t i, e, r;
+	__m128i f, l, fm, lm, x, y;
+	unsigned m;
+
+	e = n - t->l + 1; /* positions */
+	f  = _mm_set1_epi8(t->s[0]);
+	l  = _mm_set1_epi8(t->s[t->l - 1]);
+	fm = _mm_set1_epi8(t->msk[0]);
+	lm = _mm_set1_epi8(t->msk[t->l - 1]);
+
+	for (i = 0; i + 16 <= e; i += 16) {
+		x = _mm_loadu_si128((const __m128i *)(b + i));
+		y = _mm_loadu_si128((const __m128i *)(b + i + t->l - 1));
+		m = _mm_movemask_epi8(_mm_and_si128(
+		    _mm_cmpeq_epi8(_mm_or_si128(x, fm), f),
+		    _mm_cmpeq_epi8(_mm_or_si128(y, lm), l)));
+
+		for (; m; m &= m - 1) {
+			if (!lit_cmp(t, b + i + __builtin_ctz(m))) {
+				return i + __builtin_ctz(m);
+			}
+		}
+	}
+
+	r = lit_scal(t, b + i, n - i);
+	return r == LIT_NONE ? r : i + r;
+}
+#endif
+
+#ifdef LIT_AVX2
+__attribute__((target("avx2")))
+static size_t
+lit_avx2(const struct lit *t, const unsigned char *b, size_t n)
+{
+	size_t i, e, r;
+	__m256i f, l, fm, lm, x, y;
+	unsigned m;
+
+	e = n - t->l + 1;
+	f  = _mm256_set1_epi8(t->s[0]);
+	l  = _mm256_set1_epi8(t->s[t->l - 1]);
+	fm = _mm256_set1_epi8(t->msk[0]);
+	lm = _mm256_set1_epi8(t->msk[t->l - 1]);
+
+	for (i = 0; i + 32 <= e; i += 32) {
+		x = _mm256_loadu_si256((const __m256i *)(b + i));
+		y = _mm256_loadu_si256((const __m256i *)(b + i + t->l - 1));
+		m = _mm256_movemask_epi8(_mm256_and_si256(
+		    _mm256_cmpeq_epi8(_mm256_or_si256(x, fm), f),
+		    _mm256_cmpeq_epi8(_mm256_or_si256(y, lm), l)));
+
+		for (; m; m &= m - 1) {
+			if (!lit_cmp(t, b + i + __builtin_ctz(m))) {
+				return i + __builtin_ctz(m);
+			}
+		}
+	}
+
+	r = lit_scal(t, b + i, n - i);
+	return r == LIT_NONE ? r : i + r;
+}
+#endif
@@ -0,0 +1,13 @@
+/* Literal which each match of a regular expression contains */
+struct lit {
+	unsigned char *s; /* lower case if the case is ignored */
+	unsigned char *msk; /* 0x20 for letters if the case is ignored */
+	size_t l; /* 0: No literal */
+	bool all; /* Pattern matches the literal only */
+};
+
+#define LIT_NONE ((size_t)-1)
+
+void lit_mk(struct lit *, const char *, int);
+void lit_free(struct lit *);
+size_t lit_find(const struct lit *, const void *, size_t);
@@ -27,6 +27,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <unistd.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include "compat.h"
 #include "main.h"
 #include "y.tab.h"
@@ -41,6 +42,11 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "tc.h"
 #include "info.h"
 #include "lex.h"
+#include "pool.h"
+#include "uring.h"
+#include "dgst.h"
+#include "gqi.h"
+#include "fcmp.h"
 
 int yyparse(void);
 
@@ -70,10 +76,10 @@ static void runs2x(void);
 
 const char rc_name[] = "." BIN "rc";
 static char *usage_txt =
-"Usage: %s [-u [<RC file>]] [-BbCcdEefgIiklMmNnoqRrVWXy] [-F <pattern>]\n"
-"	[-G <pattern>] [-P <last_wd_file>] [-t <diff_tool>] [-v <view_tool>]\n"
-"	[<file or directory 1> [<file or directory 2>]]\n";
-static char *getopt_arg = "BbCcdEeF:fG:gIiklMmNnoP:qRrt:Vv:WXy";
+"Usage: %s [-u [<RC file>]] [-BbCcdEefgIiklMmNnOoqRrUVWXy] [-F <pattern>]\n"
+"	[-G <pattern>] [-j <threads>] [-P <last_wd_file>] [-t <diff_tool>]\n"
+"	[-v <view_tool>] [<file or directory 1> [<file or directory 2>]]\n";
+static char *getopt_arg = "BbCcdEeF:fG:gIij:klMmNnOoP:qRrt:UVv:WXy";
 
 char *printwd;
 bool bmode;
@@ -94,6 +100,7 @@ main(int argc, char **argv)
 
 	prog = *argv;
 	setlocale(LC_ALL, "");
+	fcmp_init();
 
 #ifdef TRACE
 	{
@@ -198,6 +205,9 @@ main(int argc, char **argv)
 		case 'i':
 			noic = 0; /* ignore case */
 			break;
+		case 'j':
+			nworkers = atoi(optarg);
+			break;
 		case 'k':
 			set_tool(&difftool, strdup("tkdiff"), TOOL_BG);
 			break;
@@ -220,6 +230,9 @@ main(int argc, char **argv)
 		case 'n':
 			noequal = 1;
 			break;
+		case 'O':
+			ino_order = 1;
+			break;
 		case 'o':
 			nosingle = 3;
 			break;
@@ -243,6 +256,9 @@ main(int argc, char **argv)
 		case 't':
 			set_tool(&difftool, strdup(optarg), 0);
 			break;
+		case 'U':
+			use_uring = 1;
+			break;
 		case 'V':
 			printf(BIN " %s\n\tCompile option(s): "
 #if defined HAVE_NCURSESW_CURSES_H
@@ -265,7 +281,13 @@ main(int argc, char **argv)
 #else
 			    "tsearch"
 #endif
-			    "\n", version);
+#ifdef HAVE_PTHREAD
+			    ", pthread"
+#endif
+#ifdef HAVE_IO_URING
+			    ", io_uring"
+#endif
+			    "\n\tCompare kernel: %s\n", version, fcmp_name());
 			exit(0);
 		case 'v':
 			set_tool(&viewtool, strdup(optarg), 0);
@@ -367,6 +389,8 @@ main(int argc, char **argv)
 	pwd  = syspth[0] + pthlen[0];
 	rpwd = syspth[1] + pthlen[1];
 	info_load();
+	dgst_load();
+	gqi_ini((zipfile[0] ? 1 : 0) | (zipfile[1] ? 2 : 0));
 	build_ui();
 
 	if (printwd) {
@@ -6,12 +6,30 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <regex.h>
+#include <pwd.h>
+#include <grp.h>
 #include <stdarg.h>
 #include "compat.h"
 #include "misc.h"
 #include "main.h"
 #include "ui.h"
 
+/* User and group names for the owner and group columns.  Each lookup
+ * may ask a name service (LDAP, ...), so all results are kept for the
+ * whole session, unknown IDs too (name NULL). */
+
+struct id_name {
+	struct id_name *next;
+	unsigned long id;
+	char *name;
+};
+
+#define ID_HASH 256
+
+static struct id_name *id_lookup(struct id_name **, unsigned long, bool);
+
+static struct id_name *usr_tbl[ID_HASH], *grp_tbl[ID_HASH];
+
 int
 getuwidth(unsigned long u)
 {
@@ -47,3 +65,49 @@ str_eq_dotdot(const char *s) {
 
 	return FALSE;
 }
+
+/* Returns the user name of {u} or NULL if there is none */
+
+const char *
+usr_name(uid_t u)
+{
+	return id_lookup(usr_tbl, (unsigned long)u, FALSE)->name;
+}
+
+/* Returns the group name of {g} or NULL if there is none */
+
+const char *
+grp_name(gid_t g)
+{
+	return id_lookup(grp_tbl, (unsigned long)g, TRUE)->name;
+}
+
+static struct id_name *
+id_lookup(struct id_name **tbl, unsigned long id, bool grp)
+{
+	struct id_name *n, **h;
+	struct passwd *pw;
+	struct group *gr;
+	const char *s;
+
+	h = &tbl[id % ID_HASH];
+
+	for (n = *h; n; n = n->next) {
+		if (n->id == id) {
+			return n;
+		}
+	}
+
+	if (grp) {
+		s = (gr = getgrgid((gid_t)id)) ? gr->gr_name : NULL;
+	} else {
+		s = (pw = getpwuid((uid_t)id)) ? pw->pw_name : NULL;
+	}
+
+	n = malloc(sizeof(struct id_name));
+	n->id = id;
+	n->name = s ? strdup(s) : NULL;
+	n->next = *h;
+	*h = n;
+	return n;
+}
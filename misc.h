@@ -1,3 +1,5 @@
 int getuwidth(unsigned long);
 char *msgrealpath(const char *);
 bool str_eq_dotdot(const char *);
+const char *usr_name(uid_t);
+const char *grp_name(gid_t);
@@ -22,16 +22,25 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <stdarg.h>
 #include <signal.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include "compat.h"
 #include "main.h"
 #include "exec.h"
 #include "ui.h"
 #include "ui2.h"
 #include "uzp.h"
+#include "pool.h"
+#include "stx.h"
+#include "uring.h"
+#include "dgst.h"
+#include "gqi.h"
+#include "lcache.h"
+#include "pfch.h"
 #include "db.h"
 #include "ed.h"
 #include "lex.h"
 #include "diff.h"
+#include "gq.h"
 #include "tc.h"
 #include "pars.h"
 
@@ -48,7 +57,8 @@ extern char *yytext;
 %token SHELL SH NORMAL_COLOR CURSOR_COLOR ERROR_COLOR MARK_COLOR BG_COLOR
 %token ALIAS TWOCOLUMN READONLY DISP_PERM DISP_OWNER DISP_GROUP DISP_HSIZE
 %token DISP_MTIME MMRK_COLOR LOCALE FILE_EXEC UZ_ADD UZ_DEL WAIT NOBOLD DOTDOT
-%token SORTIC
+%token SORTIC THREADS STAT_NOSYNC IO_URING INODE_ORDER DIGEST_CACHE LIST_CACHE
+%token PREFETCH INCREMENTAL GREP_INDEX GREP_UNPACK
 %token <str>     STRING
 %token <integer> INTEGER
 %%
@@ -119,6 +129,16 @@ option:
 	| FILE_EXEC                    { file_exec = TRUE                 ; }
 	| DOTDOT                       { dotdot = TRUE                    ; }
 	| SORTIC                       { sortic = TRUE                    ; }
+	| THREADS INTEGER              { nworkers = $2                    ; }
+	| STAT_NOSYNC                  { stat_nosync = 1                  ; }
+	| IO_URING                     { use_uring = 1                    ; }
+	| INODE_ORDER                  { ino_order = 1                    ; }
+	| DIGEST_CACHE INTEGER         { dgst_max = $2                    ; }
+	| LIST_CACHE INTEGER           { lc_max = $2                      ; }
+	| PREFETCH INTEGER             { pf_max = $2                      ; }
+	| INCREMENTAL                  { inc_list = TRUE                  ; }
+	| GREP_INDEX INTEGER           { gqi_max = $2                     ; }
+	| GREP_UNPACK INTEGER          { gq_zmax = $2                     ; }
 	| LOCALE STRING {
 			if (!setlocale(LC_ALL, $2)) {
 				printf("locale LC_ALL=%s cannot be set\n",
@@ -0,0 +1,692 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Prefetch of the directories around the cursor in diff mode.  While the
+ * main thread waits for a key, the subdirectories in the rows near the
+ * cursor (and the next directory below the cursor, which is entered next
+ * when the directories are stepped through) are read by a small thread
+ * pool with idle I/O priority.  The names and exactly the stat() results
+ * which build_diff_db() needs are kept.  When one of these directories is
+ * entered, build_diff_db() takes them instead of reading the directory.
+ *
+ * A result is only used if the modification and change times of its
+ * directories are unchanged and it is at most PF_MAXAGE seconds old.
+ * Files which are changed in place do not change their directory.
+ * Results are dropped when the cursor moves away or another list is
+ * displayed.  The worker threads do not access the list. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <regex.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef __linux__
+# include <sys/syscall.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "diff.h"
+#include "exec.h"
+#include "uzp.h"
+#include "db.h"
+#include "ui2.h"
+#include "tc.h"
+#include "pool.h"
+#include "stx.h"
+#include "dnam.h"
+#include "pfch.h"
+
+/* Job states */
+#define PF_QUEUE 0
+#define PF_RUN   1
+#define PF_DONE  2
+#define PF_FAIL  3
+
+/* Directory rows above and below the cursor which are prefetched */
+#define PF_NEAR 4
+/* Cursor row, next directory and the rows around the cursor */
+#define PF_NJOB (2 * PF_NEAR + 2)
+/* Rows below the cursor which are searched for the next directory */
+#define PF_NEXT 1000
+/* Seconds a result is used after it had been read */
+#define PF_MAXAGE 2
+/* Memory limit for the stat() results of all jobs */
+#define PF_MAXMEM (32 * 1024 * 1024)
+
+/* Slot {k} of pass {rp} is read (see ubat_fill()) */
+#define PF_SLOT(j, rp, k) (!((rp) && (k) < 2) && \
+    ((j)->tree & ((k) < 2 ? 1 : 2)) && (((k) & 1) || (j)->flnk))
+
+struct pf_st {
+	struct stat st;
+	int err; /* errno, 0: OK, -1: Not read */
+};
+
+struct pfch {
+	char *name; /* list entry */
+	char *pth[2];
+	short tree; /* 1: left, 2: right, 3: both */
+	short flnk; /* followlinks */
+	unsigned msk; /* diff_stmask() */
+	/* The directories before they had been read */
+	struct stat dst[2];
+	struct dnam nam[2];
+	/* [pass][slot]: Pass 0 is indexed by the left names, pass 1 by the
+	 * right names.  Slots as for ubat_stat(). */
+	struct pf_st *v[2][4];
+	size_t mem;
+	struct timespec done; /* CLOCK_MONOTONIC when read */
+	volatile int stop;
+	char st;
+};
+
+static int pf_init(void);
+static int pf_tree(struct filediff *);
+static int pf_want(struct pfch **, unsigned *, struct filediff *);
+static struct pfch *pf_next(void);
+static void pf_task(void *, unsigned);
+static int pf_dirs(struct pfch *);
+static int pf_names(struct pfch *, int, unsigned *);
+static void pf_jfree(struct pfch *);
+
+/* Maximum number of concurrent prefetches, 0: disabled (RC file option) */
+unsigned pf_max;
+static struct pool *pf_pool;
+static unsigned pf_nthr, pf_ntask;
+/* In priority order.  Locked with pool_lock(). */
+static struct pfch *pf_jobs[PF_NJOB];
+static unsigned pf_njob;
+static size_t pf_mem;
+/* List and cursor of the last pf_near() */
+static struct filediff **pf_list, *pf_f;
+static unsigned pf_num, pf_u;
+static char *pf_dir[2];
+
+/* Updates the jobs for the rows near the cursor.  Called while the main
+ * thread waits for a key. */
+
+void
+pf_near(void)
+{
+	struct filediff **l;
+	struct pfch *w[PF_NJOB];
+	unsigned u, n, nw = 0, i, k;
+	int d;
+
+	if (!pf_max || bmode || fmode || !(n = db_num[0])) {
+		return;
+	}
+
+	l = db_list[0];
+	u = top_idx[0] + curs[0];
+
+	if (l == pf_list && n == pf_num && u == pf_u &&
+	    (u >= n || l[u] == pf_f)) {
+		return;
+	}
+
+	if (!pf_pool && !pf_init()) {
+		return;
+	}
+
+	for (i = 0; i < 2; i++) {
+		syspth[i][pthlen[i]] = 0;
+	}
+
+	if (!pf_dir[0] || strcmp(pf_dir[0], syspth[0]) ||
+	    strcmp(pf_dir[1], syspth[1])) {
+		pf_flush();
+		pf_dir[0] = strdup(syspth[0]);
+		pf_dir[1] = strdup(syspth[1]);
+	}
+
+	pf_list = l;
+	pf_num = n;
+	pf_u = u;
+	pf_f = u < n ? l[u] : NULL;
+	pool_lock(pf_pool);
+
+	if (u < n) {
+		pf_want(w, &nw, l[u]);
+
+		for (i = u + 1; i < n && i <= u + PF_NEXT; i++) {
+			if (pf_tree(l[i])) {
+				pf_want(w, &nw, l[i]);
+				break;
+			}
+		}
+
+		for (d = 1; d <= PF_NEAR; d++) {
+			if (u + d < n) {
+				pf_want(w, &nw, l[u + d]);
+			}
+
+			if (u >= (unsigned)d) {
+				pf_want(w, &nw, l[u - d]);
+			}
+		}
+	}
+
+	/* Jobs which are not wanted anymore */
+	for (i = 0; i < pf_njob; i++) {
+		for (k = 0; k < nw && w[k] != pf_jobs[i]; k++);
+
+		if (k < nw) {
+			continue;
+		}
+
+		if (pf_jobs[i]->st == PF_RUN) {
+			/* Freed by pf_task() */
+			pf_jobs[i]->stop = 1;
+		} else {
+			pf_jfree(pf_jobs[i]);
+		}
+	}
+
+	memcpy(pf_jobs, w, nw * sizeof(struct pfch *));
+	pf_njob = nw;
+
+	for (i = 0; i < nw && pf_ntask < pf_nthr; i++) {
+		if (w[i]->st == PF_QUEUE) {
+			pf_ntask++;
+			pool_add(pf_pool, POOL_MAIN, pf_task, NULL);
+		}
+	}
+
+	pool_unlock(pf_pool);
+}
+
+/* Called by build_diff_db(): Returns the prefetched result for the
+ * directories in syspth[] if it is valid, else NULL.  {msk}:
+ * diff_stmask() */
+
+struct pfch *
+pf_take(int tree, unsigned msk)
+{
+	struct pfch *j = NULL;
+	struct stat st;
+	struct timespec ts;
+	unsigned i;
+
+	if (!pf_pool) {
+		return NULL;
+	}
+
+	pool_lock(pf_pool);
+
+	for (i = 0; i < pf_njob; i++) {
+		j = pf_jobs[i];
+
+		if (j->tree == tree &&
+		    (!(tree & 1) || !strcmp(j->pth[0], syspth[0])) &&
+		    (!(tree & 2) || !strcmp(j->pth[1], syspth[1]))) {
+			break;
+		}
+	}
+
+	if (i == pf_njob) {
+		pool_unlock(pf_pool);
+		return NULL;
+	}
+
+	pf_njob--;
+	memmove(pf_jobs + i, pf_jobs + i + 1,
+	    (pf_njob - i) * sizeof(struct pfch *));
+
+	/* It is read just now, doing it again would take longer */
+	while (j->st == PF_RUN) {
+		pool_unlock(pf_pool);
+		ts.tv_sec = 0;
+		ts.tv_nsec = 1000000;
+		nanosleep(&ts, NULL);
+		pool_lock(pf_pool);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	if (j->st != PF_DONE || j->msk != msk || j->flnk != followlinks ||
+	    ts.tv_sec - j->done.tv_sec > PF_MAXAGE) {
+		goto drop;
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (!(tree & (1 << i))) {
+			continue;
+		}
+
+		if (stat(j->pth[i], &st) == -1 ||
+		    st.st_dev != j->dst[i].st_dev ||
+		    st.st_ino != j->dst[i].st_ino ||
+		    memcmp(&st.st_mtim, &j->dst[i].st_mtim,
+		      sizeof st.st_mtim) ||
+		    memcmp(&st.st_ctim, &j->dst[i].st_ctim,
+		      sizeof st.st_ctim)) {
+			goto drop;
+		}
+	}
+
+	pool_unlock(pf_pool);
+#if defined(TRACE)
+	fprintf(debug, "<>pf_take(%d): %s %s\n", tree, syspth[0], syspth[1]);
+#endif
+	return j;
+
+drop:
+	pf_jfree(j);
+	pool_unlock(pf_pool);
+	return NULL;
+}
+
+/* dnam_read() which takes the names of {j} if available. {i}: 0: left,
+ * 1: right */
+
+int
+pf_read(struct pfch *j, int i, struct dnam *d, const char *pth, int dots)
+{
+	if (!j || !(j->tree & (1 << i))) {
+		return dnam_read(d, pth, dots);
+	}
+
+	*d = j->nam[i];
+	memset(&j->nam[i], 0, sizeof(struct dnam));
+
+	/* build_diff_db() pairs the names again */
+	if (d->num) {
+		memset(d->pr, 0, d->num);
+	}
+
+	return 0;
+}
+
+/* Result of stat() (even {slot}) or lstat() (odd {slot}) for name {ni} in
+ * pass {rp}.  1: Not prefetched, else as stat() */
+
+int
+pf_stat(struct pfch *j, int rp, size_t ni, int slot, struct stat *st)
+{
+	struct pf_st *v;
+
+	if (!(v = j->v[rp][slot]) || (v += ni)->err == -1) {
+		return 1;
+	}
+
+	if (v->err) {
+		errno = v->err;
+		return -1;
+	}
+
+	*st = v->st;
+	return 0;
+}
+
+/* Frees a result of pf_take() */
+
+void
+pf_free(struct pfch *j)
+{
+	if (!j) {
+		return;
+	}
+
+	pool_lock(pf_pool);
+	pf_jfree(j);
+	pool_unlock(pf_pool);
+}
+
+/* Drops all results, e.g. after file operations */
+
+void
+pf_flush(void)
+{
+	unsigned i;
+
+	free(pf_dir[0]);
+	free(pf_dir[1]);
+	pf_dir[0] = pf_dir[1] = NULL;
+	pf_list = NULL;
+
+	if (!pf_pool) {
+		return;
+	}
+
+	pool_lock(pf_pool);
+
+	for (i = 0; i < pf_njob; i++) {
+		if (pf_jobs[i]->st == PF_RUN) {
+			pf_jobs[i]->stop = 1;
+		} else {
+			pf_jfree(pf_jobs[i]);
+		}
+	}
+
+	pf_njob = 0;
+	pool_unlock(pf_pool);
+}
+
+/* ":set prefetch=" */
+
+void
+pf_set(unsigned n)
+{
+	pf_flush();
+
+	if (pf_pool && n != pf_nthr) {
+		/* Waits for running tasks */
+		pool_free(pf_pool);
+		pf_pool = NULL;
+		pf_ntask = 0;
+	}
+
+	pf_max = n;
+}
+
+static int
+pf_init(void)
+{
+	static bool err;
+
+	if (!pf_pool && !err) {
+		pf_nthr = pf_max;
+
+		if (!(pf_pool = pool_new(pf_nthr))) {
+			err = TRUE;
+		}
+	}
+
+	return pf_pool ? 1 : 0;
+}
+
+/* {tree} argument of enter_dir() for a list entry, 0: no directory */
+
+static int
+pf_tree(struct filediff *f)
+{
+	int l, r;
+
+	l = S_ISDIR(f->type[0]);
+	r = S_ISDIR(f->type[1]);
+
+	return l && r ? 3 : l && !f->type[1] ? 1 : r && !f->type[0] ? 2 : 0;
+}
+
+/* Adds the job for {f} to {w}.  An existing job is reused.  Called
+ * locked. */
+
+static int
+pf_want(struct pfch **w, unsigned *nw, struct filediff *f)
+{
+	struct pfch *j;
+	unsigned i;
+	int t;
+
+	if (!(t = pf_tree(f))) {
+		return 0;
+	}
+
+	for (i = 0; i < *nw; i++) {
+		if (w[i]->tree == t && !strcmp(w[i]->name, f->name)) {
+			return 0;
+		}
+	}
+
+	for (i = 0; i < pf_njob; i++) {
+		j = pf_jobs[i];
+
+		if (j->tree == t && !strcmp(j->name, f->name)) {
+			w[(*nw)++] = j;
+			return 0;
+		}
+	}
+
+	j = calloc(1, sizeof(struct pfch));
+	j->name = strdup(f->name);
+	j->tree = t;
+	j->flnk = followlinks;
+	j->msk = diff_stmask();
+
+	for (i = 0; i < 2; i++) {
+		if (t & (1 << i)) {
+			pthcat(syspth[i], pthlen[i], f->name);
+			j->pth[i] = strdup(syspth[i]);
+			syspth[i][pthlen[i]] = 0;
+		}
+	}
+
+	w[(*nw)++] = j;
+	return 1;
+}
+
+/* Next queued job in priority order.  Called locked. */
+
+static struct pfch *
+pf_next(void)
+{
+	unsigned i;
+
+	for (i = 0; i < pf_njob; i++) {
+		if (pf_jobs[i]->st == PF_QUEUE) {
+			return pf_jobs[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Runs jobs until none is left */
+
+static void
+pf_task(void *arg, unsigned w)
+{
+	struct pfch *j;
+	int r;
+
+	(void)arg;
+	(void)w;
+#if defined(__linux__) && defined(SYS_ioprio_set)
+	/* IOPRIO_WHO_PROCESS, this thread, IOPRIO_CLASS_IDLE */
+	syscall(SYS_ioprio_set, 1, 0, 3 << 13);
+#endif
+	pool_lock(pf_pool);
+
+	while ((j = pf_next())) {
+		j->st = PF_RUN;
+		pool_unlock(pf_pool);
+		r = pf_dirs(j);
+		pool_lock(pf_pool);
+
+		if (j->stop) {
+			pf_jfree(j);
+			continue;
+		}
+
+		j->st = r ? PF_FAIL : PF_DONE;
+		clock_gettime(CLOCK_MONOTONIC, &j->done);
+	}
+
+	pf_ntask--;
+	pool_unlock(pf_pool);
+}
+
+/* Reads the directories of {j}.  Errors are left to build_diff_db().
+ * !0: Error */
+
+static int
+pf_dirs(struct pfch *j)
+{
+	unsigned stm[2] = { 0, 0 };
+	size_t m;
+	int i, k;
+
+	for (i = 0; i < 2; i++) {
+		if (!(j->tree & (1 << i))) {
+			continue;
+		}
+
+		if (stat(j->pth[i], &j->dst[i]) == -1 ||
+		    dnam_read(&j->nam[i], j->pth[i], 0) || j->stop) {
+			return -1;
+		}
+
+		stm[i] = j->msk | stx_dirfl(j->pth[i]);
+	}
+
+	if (j->tree == 3) {
+		dnam_pair(&j->nam[0], &j->nam[1]);
+	}
+
+	m = 0;
+
+	for (i = 0; i < 2; i++) {
+		for (k = 0; k < 4; k++) {
+			if (PF_SLOT(j, i, k)) {
+				m += j->nam[i].num * sizeof(struct pf_st);
+			}
+		}
+	}
+
+	pool_lock(pf_pool);
+
+	if (pf_mem + m > PF_MAXMEM) {
+		pool_unlock(pf_pool);
+		return -1;
+	}
+
+	pf_mem += j->mem = m;
+	pool_unlock(pf_pool);
+
+	if ((j->tree & 1) && pf_names(j, 0, stm)) {
+		return -1;
+	}
+
+	if ((j->tree & 2) && pf_names(j, 1, stm)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* stat()s the names of pass {rp} like build_diff_db() */
+
+static int
+pf_names(struct pfch *j, int rp, unsigned *stm)
+{
+	struct dnam *d = &j->nam[rp];
+	char *p[2] = { NULL, NULL };
+	size_t n, k, l, pl[2] = { 0, 0 };
+	int i, s[2], r = 0;
+
+	for (i = 0; i < 2; i++) {
+		if (!(j->tree & (1 << i))) {
+			continue;
+		}
+
+		pl[i] = strlen(j->pth[i]);
+		p[i] = malloc(pl[i] + 258);
+		memcpy(p[i], j->pth[i], pl[i]);
+
+		if (!pl[i] || p[i][pl[i] - 1] != '/') {
+			p[i][pl[i]++] = '/';
+		}
+	}
+
+	for (k = 0; k < 4; k++) {
+		if (!PF_SLOT(j, rp, k)) {
+			continue;
+		}
+
+		j->v[rp][k] = malloc(d->num * sizeof(struct pf_st));
+
+		for (n = 0; n < d->num; n++) {
+			j->v[rp][k][n].err = -1;
+		}
+	}
+
+	for (n = 0; n < d->num; n++) {
+		if (!(n & 63) && j->stop) {
+			r = -1;
+			break;
+		}
+
+		if (rp) {
+			if (d->pr[n]) {
+				continue;
+			}
+
+			s[0] = -1;
+			s[1] = DNAM_TYP(d->v[n]);
+		} else {
+			s[0] = DNAM_TYP(d->v[n]);
+			s[1] = !(j->tree & 2) || !d->pr[n] ? -1 :
+			    DNAM_PRTYP(d->pr[n]);
+		}
+
+		if ((l = strlen(d->v[n])) > 255) {
+			continue;
+		}
+
+		for (i = 0; i < 2; i++) {
+			struct pf_st *v;
+
+			if (s[i] < 0 || pl[i] + l + 2 > PATHSIZ) {
+				continue;
+			}
+
+			memcpy(p[i] + pl[i], d->v[n], l + 1);
+
+			if (j->flnk) {
+				v = &j->v[rp][i * 2][n];
+				v->err = stx_stat(p[i], &v->st, stm[i]) == -1 ?
+				    errno : 0;
+			}
+
+			if (!j->flnk || DNAM_MAYLNK(s[i])) {
+				v = &j->v[rp][i * 2 + 1][n];
+				v->err = stx_lstat(p[i], &v->st, stm[i]) ==
+				    -1 ? errno : 0;
+			}
+		}
+	}
+
+	free(p[0]);
+	free(p[1]);
+	return r;
+}
+
+/* Called locked */
+
+static void
+pf_jfree(struct pfch *j)
+{
+	int i, k;
+
+	for (i = 0; i < 2; i++) {
+		free(j->pth[i]);
+		dnam_free(&j->nam[i]);
+
+		for (k = 0; k < 4; k++) {
+			free(j->v[i][k]);
+		}
+	}
+
+	pf_mem -= j->mem;
+	free(j->name);
+	free(j);
+}
@@ -0,0 +1,12 @@
+struct pfch;
+struct dnam;
+
+extern unsigned pf_max;
+
+void pf_near(void);
+struct pfch *pf_take(int, unsigned);
+int pf_read(struct pfch *, int, struct dnam *, const char *, int);
+int pf_stat(struct pfch *, int, size_t, int, struct stat *);
+void pf_free(struct pfch *);
+void pf_flush(void);
+void pf_set(unsigned);
@@ -0,0 +1,410 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Work-stealing thread pool.  Each worker has its own task deque.  A worker
+ * pushes and pops tasks at the bottom of its own deque (LIFO, keeps the
+ * directory tree traversal depth first and cache friendly) and steals from
+ * the top of the deques of the other workers when its own deque is empty. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD
+# include <pthread.h>
+#endif
+#include "pool.h"
+
+#define POOL_MAXWORKERS 64
+
+/* 0: Number of online CPUs */
+unsigned nworkers;
+
+#ifdef HAVE_PTHREAD
+struct pool_task {
+	void (*fn)(void *, unsigned);
+	void *arg;
+};
+
+struct pool_q {
+	pthread_mutex_t mtx;
+	struct pool_task *v;
+	size_t siz; /* power of 2 */
+	size_t top, bot; /* top <= bot, indices modulo siz */
+};
+
+struct pool_thr {
+	struct pool *pool;
+	unsigned idx;
+	pthread_t tid;
+};
+
+struct pool {
+	pthread_mutex_t mtx;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	/* Lock for the users of the pool */
+	pthread_mutex_t umtx;
+	struct pool_q *q;
+	struct pool_thr *thr;
+	unsigned num;
+	unsigned rr; /* round-robin index for POOL_MAIN */
+	unsigned long queued;
+	unsigned long pending; /* queued + running */
+	/* Frees the argument of a task which is not run, see pool_drop() */
+	void (*drop)(void *);
+	short quit;
+};
+
+static void *pool_thread(void *);
+static void pool_run(struct pool *, unsigned);
+static int pool_pop(struct pool_q *, struct pool_task *, int);
+#endif
+
+unsigned
+pool_nworkers(void)
+{
+	long n;
+
+	if (nworkers) {
+		n = nworkers;
+	} else if ((n = sysconf(_SC_NPROCESSORS_ONLN)) < 1) {
+		n = 1;
+	}
+
+	if (n > POOL_MAXWORKERS) {
+		n = POOL_MAXWORKERS;
+	}
+
+#ifndef HAVE_PTHREAD
+	n = 1;
+#endif
+	return n;
+}
+
+/* NULL: Error or no thread support. The caller has to do the work itself
+ * then. */
+
+struct pool *
+pool_new(unsigned n)
+{
+#ifdef HAVE_PTHREAD
+	struct pool *p;
+	unsigned i;
+
+	if (!n) {
+		return NULL;
+	}
+
+	p = calloc(1, sizeof(struct pool));
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_mutex_init(&p->umtx, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->idle, NULL);
+	p->q = calloc(n, sizeof(struct pool_q));
+	p->thr = calloc(n, sizeof(struct pool_thr));
+
+	for (i = 0; i < n; i++) {
+		pthread_mutex_init(&p->q[i].mtx, NULL);
+		p->q[i].siz = 64;
+		p->q[i].v = malloc(p->q[i].siz * sizeof(struct pool_task));
+	}
+
+	for (i = 0; i < n; i++) {
+		p->thr[i].pool = p;
+		p->thr[i].idx = i;
+
+		if (pthread_create(&p->thr[i].tid, NULL, pool_thread,
+		    &p->thr[i])) {
+			break;
+		}
+
+		p->num++;
+	}
+
+	if (!p->num) {
+		pool_free(p);
+		return NULL;
+	}
+
+	return p;
+#else
+	(void)n;
+	return NULL;
+#endif
+}
+
+/* Add a task. {w} is the index of the calling worker or POOL_MAIN. */
+
+void
+pool_add(struct pool *p, unsigned w, void (*fn)(void *, unsigned), void *arg)
+{
+#ifdef HAVE_PTHREAD
+	struct pool_q *q;
+
+	if (w >= p->num) {
+		pthread_mutex_lock(&p->mtx);
+		w = p->rr++ % p->num;
+		pthread_mutex_unlock(&p->mtx);
+	}
+
+	q = &p->q[w];
+	pthread_mutex_lock(&q->mtx);
+
+	if (q->bot - q->top == q->siz) {
+		struct pool_task *v;
+		size_t i;
+
+		v = malloc(2 * q->siz * sizeof(struct pool_task));
+
+		for (i = q->top; i != q->bot; i++) {
+			v[i & (2 * q->siz - 1)] = q->v[i & (q->siz - 1)];
+		}
+
+		free(q->v);
+		q->v = v;
+		q->siz *= 2;
+	}
+
+	q->v[q->bot & (q->siz - 1)].fn = fn;
+	q->v[q->bot & (q->siz - 1)].arg = arg;
+	q->bot++;
+	pthread_mutex_unlock(&q->mtx);
+
+	pthread_mutex_lock(&p->mtx);
+	p->queued++;
+	p->pending++;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+#else
+	(void)p;
+	(void)w;
+	fn(arg, 0);
+#endif
+}
+
+/* Wait at most {ms} milliseconds for all tasks to be done.
+ * 0: All done, 1: Timeout */
+
+int
+pool_wait(struct pool *p, unsigned ms)
+{
+#ifdef HAVE_PTHREAD
+	struct timespec ts;
+	int r;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000L;
+
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&p->mtx);
+
+	while (p->pending) {
+		if (pthread_cond_timedwait(&p->idle, &p->mtx, &ts) ==
+		    ETIMEDOUT) {
+			break;
+		}
+	}
+
+	r = p->pending ? 1 : 0;
+	pthread_mutex_unlock(&p->mtx);
+	return r;
+#else
+	(void)p;
+	(void)ms;
+	return 0;
+#endif
+}
+
+void
+pool_lock(struct pool *p)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&p->umtx);
+#else
+	(void)p;
+#endif
+}
+
+void
+pool_unlock(struct pool *p)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&p->umtx);
+#else
+	(void)p;
+#endif
+}
+
+/* Sets the function which frees the argument of a task which is
+ * discarded by pool_free() */
+
+void
+pool_drop(struct pool *p, void (*fn)(void *))
+{
+#ifdef HAVE_PTHREAD
+	p->drop = fn;
+#else
+	(void)p;
+	(void)fn;
+#endif
+}
+
+/* Waits for running tasks. Tasks which had not been started are
+ * discarded, their arguments are freed with the function of
+ * pool_drop(). */
+
+void
+pool_free(struct pool *p)
+{
+#ifdef HAVE_PTHREAD
+	unsigned i;
+	size_t k;
+
+	if (!p) {
+		return;
+	}
+
+	pthread_mutex_lock(&p->mtx);
+	p->quit = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+
+	for (i = 0; i < p->num; i++) {
+		pthread_join(p->thr[i].tid, NULL);
+	}
+
+	for (i = 0; i < p->num; i++) {
+		if (p->drop) {
+			for (k = p->q[i].top; k != p->q[i].bot; k++) {
+				p->drop(p->q[i].v[k & (p->q[i].siz - 1)].arg);
+			}
+		}
+
+		pthread_mutex_destroy(&p->q[i].mtx);
+		free(p->q[i].v);
+	}
+
+	pthread_mutex_destroy(&p->mtx);
+	pthread_mutex_destroy(&p->umtx);
+	pthread_cond_destroy(&p->work);
+	pthread_cond_destroy(&p->idle);
+	free(p->q);
+	free(p->thr);
+	free(p);
+#else
+	(void)p;
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+pool_thread(void *arg)
+{
+	struct pool_thr *t = arg;
+
+	pool_run(t->pool, t->idx);
+	return NULL;
+}
+
+static void
+pool_run(struct pool *p, unsigned w)
+{
+	struct pool_task t;
+	unsigned i;
+
+	while (1) {
+		if (pool_pop(&p->q[w], &t, 0)) {
+			goto run;
+		}
+
+		for (i = 1; i < p->num; i++) {
+			if (pool_pop(&p->q[(w + i) % p->num], &t, 1)) {
+				goto run;
+			}
+		}
+
+		pthread_mutex_lock(&p->mtx);
+
+		while (!p->queued && !p->quit) {
+			pthread_cond_wait(&p->work, &p->mtx);
+		}
+
+		if (p->quit) {
+			pthread_mutex_unlock(&p->mtx);
+			return;
+		}
+
+		pthread_mutex_unlock(&p->mtx);
+		continue;
+
+run:
+		pthread_mutex_lock(&p->mtx);
+		p->queued--;
+
+		if (p->quit) {
+			p->pending--;
+			pthread_mutex_unlock(&p->mtx);
+
+			if (p->drop) {
+				p->drop(t.arg);
+			}
+
+			return;
+		}
+
+		pthread_mutex_unlock(&p->mtx);
+		t.fn(t.arg, w);
+		pthread_mutex_lock(&p->mtx);
+
+		if (!--p->pending) {
+			pthread_cond_broadcast(&p->idle);
+		}
+
+		pthread_mutex_unlock(&p->mtx);
+	}
+}
+
+/* 1: Task found. {steal}: 0: Pop from bottom (own deque), 1: Pop from top
+ * (other worker's deque) */
+
+static int
+pool_pop(struct pool_q *q, struct pool_task *t, int steal)
+{
+	int r = 0;
+
+	pthread_mutex_lock(&q->mtx);
+
+	if (q->top != q->bot) {
+		if (steal) {
+			*t = q->v[q->top++ & (q->siz - 1)];
+		} else {
+			*t = q->v[--q->bot & (q->siz - 1)];
+		}
+
+		r = 1;
+	}
+
+	pthread_mutex_unlock(&q->mtx);
+	return r;
+}
+#endif
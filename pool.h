@@ -0,0 +1,16 @@
+/* Worker index of the calling thread for pool_add() if this is not a
+ * worker of the pool */
+#define POOL_MAIN (~0U)
+
+struct pool;
+
+extern unsigned nworkers;
+
+unsigned pool_nworkers(void);
+struct pool *pool_new(unsigned);
+void pool_add(struct pool *, unsigned, void (*)(void *, unsigned), void *);
+int pool_wait(struct pool *, unsigned);
+void pool_lock(struct pool *);
+void pool_unlock(struct pool *);
+void pool_drop(struct pool *, void (*)(void *));
+void pool_free(struct pool *);
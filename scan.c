@@ -0,0 +1,591 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Parallel recursive scan (option -r) in diff mode.  Each directory pair is
+ * a task of the worker pool.  The workers use own path buffers and only
+ * report the paths of directories which contain differences.  These
+ * are added to {scan_db} by the main thread, which also polls the keyboard
+ * for '%'.  The result is the same as the one of the single threaded scan
+ * in build_diff_db(). */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <regex.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "compat.h"
+#include "main.h"
+#include "ui.h"
+#include "diff.h"
+#include "exec.h"
+#include "uzp.h"
+#include "db.h"
+#include "ui2.h"
+#include "gq.h"
+#include "tc.h"
+#include "pool.h"
+#include "dnam.h"
+#include "stx.h"
+#include "fcmp.h"
+#include "scan.h"
+
+struct pscan_dir {
+	char *pth[2];
+	short tree;
+};
+
+/* Per worker data */
+
+struct pscan_wrk {
+	char pth[2][PATHSIZ];
+	size_t len[2];
+	struct stat st[2];
+	unsigned stm[2]; /* statx() flags */
+	char buf[2][BUF_SIZE];
+	struct fcmp fc;
+};
+
+static void pscan_dir(void *, unsigned);
+static void pscan_left(struct pscan_wrk *, unsigned, struct pscan_dir *,
+    struct dnam *, int, short *);
+static void pscan_right(struct pscan_wrk *, unsigned, struct dnam *,
+    short *);
+static void pscan_push(unsigned, struct pscan_wrk *, const char *, short);
+static int pscan_stat(struct pscan_wrk *, int);
+static int pscan_lnkcmp(struct pscan_wrk *);
+static size_t pscan_cat(char *, size_t, const char *);
+static void pscan_diff(struct pscan_wrk *, int);
+static void pscan_err(const char *, ...);
+static void pscan_merge(void);
+static void pscan_dfree(void *);
+
+static struct pool *pool;
+static struct pscan_wrk *wrk;
+/* Paths of directories with differences as built by the workers (not
+ * realpath()'ed, add_diff_pth() adds the parents). Protected by
+ * pool_lock(). */
+static struct strlst *pscan_res;
+static char *pscan_msg;
+static unsigned long pscan_nerr;
+static unsigned long pscan_ndir;
+/* Copy of {dontcmp} for the workers. Set by the main thread. */
+static volatile bool pscan_nocmp;
+
+/* 0: Scan done, !0: Parallel scan not possible, use build_diff_db() */
+
+int
+pscan(void)
+{
+	struct pscan_dir *d;
+	unsigned n, i;
+	time_t t, lt;
+
+	if (qdiff || bmode || fmode || gq_pattern ||
+	    (n = pool_nworkers()) < 2) {
+		return -1;
+	}
+
+	if (!(pool = pool_new(n))) {
+		return -1;
+	}
+
+	pool_drop(pool, pscan_dfree);
+
+#if defined(TRACE)
+	fprintf(debug, "->pscan(%u) lp(%s) rp(%s)\n", n, syspth[0],
+	    syspth[1]);
+#endif
+	wrk = calloc(n, sizeof(struct pscan_wrk));
+	pscan_nocmp = dontcmp;
+	pscan_nerr = 0;
+	pscan_ndir = 0;
+	ini_int();
+	lt = time(NULL);
+
+	d = malloc(sizeof(struct pscan_dir));
+	syspth[0][pthlen[0]] = 0;
+	syspth[1][pthlen[1]] = 0;
+	d->pth[0] = strdup(syspth[0]);
+	d->pth[1] = strdup(syspth[1]);
+	d->tree = 3;
+	pool_add(pool, POOL_MAIN, pscan_dir, d);
+
+	while (pool_wait(pool, 50)) {
+		if (!pscan_nocmp && getch() == '%') {
+			dontcmp = TRUE;
+			pscan_nocmp = TRUE;
+		}
+
+		pscan_merge();
+
+		if ((t = time(NULL)) - lt) {
+			printerr(NULL, "%lu directories scanned", pscan_ndir);
+			lt = t;
+		}
+	}
+
+	pool_free(pool);
+	pool = NULL;
+
+	for (i = 0; i < n; i++) {
+		fcmp_free(&wrk[i].fc);
+	}
+
+	free(wrk);
+	pscan_merge();
+
+	if (pscan_msg) {
+		if (!ign_diff_errs && dialog(ign_txt, NULL, pscan_nerr > 1 ?
+		    "%s (and %lu more errors)" : "%s", pscan_msg,
+		    pscan_nerr - 1) == 'i') {
+			ign_diff_errs = TRUE;
+		}
+
+		free(pscan_msg);
+		pscan_msg = NULL;
+	}
+
+	nodelay(stdscr, FALSE);
+#if defined(TRACE)
+	fprintf(debug, "<-pscan %lu dirs\n", pscan_ndir);
+#endif
+	return 0;
+}
+
+static void
+pscan_dir(void *arg, unsigned w)
+{
+	struct pscan_dir *d = arg;
+	struct pscan_wrk *c = &wrk[w];
+	struct dnam ln, rn;
+	int lerr = 0, rerr = 0, rerrno = 0;
+	/* Is set if any diff is found inside a dir. */
+	short dir_diff = 0;
+
+	memset(&ln, 0, sizeof ln);
+	memset(&rn, 0, sizeof rn);
+	c->len[0] = strlen(d->pth[0]);
+	c->len[1] = strlen(d->pth[1]);
+	memcpy(c->pth[0], d->pth[0], c->len[0] + 1);
+	memcpy(c->pth[1], d->pth[1], c->len[1] + 1);
+	c->stm[0] = d->tree & 1 ? stx_dirfl(c->pth[0]) : 0;
+	c->stm[1] = d->tree & 2 ? stx_dirfl(c->pth[1]) : 0;
+
+	if (d->tree & 1) {
+		if ((lerr = dnam_read(&ln, c->pth[0], 0)) == -1) {
+			pscan_err("opendir \"%s\": %s", c->pth[0],
+			    strerror(errno));
+			goto free;
+		}
+
+		if (lerr) {
+			lerr = errno;
+		}
+	}
+
+	if (d->tree & 2) {
+		if ((rerr = dnam_read(&rn, c->pth[1], 0))) {
+			rerrno = errno;
+		}
+
+		if (rerr != -1) {
+			dnam_pair(&ln, &rn);
+		}
+	}
+
+	if (d->tree & 1) {
+		pscan_left(c, w, d, &ln, !rerr, &dir_diff);
+
+		if (lerr) {
+			c->pth[0][c->len[0]] = 0;
+			pscan_err("readdir \"%s\": %s", c->pth[0],
+			    strerror(lerr));
+			/* build_diff_db() adds the right path in this case */
+			goto end;
+		}
+
+		if (dir_diff) {
+			pscan_diff(c, 0);
+			dir_diff = 0;
+		}
+	}
+
+	if ((d->tree & 2) && !real_diff) {
+		if (rerr == -1) {
+			pscan_err("opendir \"%s\" failed: %s", c->pth[1],
+			    strerror(rerrno));
+		} else {
+			pscan_right(c, w, &rn, &dir_diff);
+
+			if (rerr && !dir_diff) {
+				pscan_err("readdir \"%s\" failed: %s",
+				    c->pth[1], strerror(rerrno));
+			}
+		}
+	}
+
+end:
+	if (dir_diff) {
+		pscan_diff(c, 1);
+	}
+
+free:
+	dnam_free(&ln);
+	dnam_free(&rn);
+	pscan_dfree(d);
+	pool_lock(pool);
+	pscan_ndir++;
+	pool_unlock(pool);
+}
+
+/* {rknown}: All names of the right directory are known, left-only names
+ * need not to be stat'ed there. */
+
+static void
+pscan_left(struct pscan_wrk *c, unsigned w, struct pscan_dir *d,
+    struct dnam *ln, int rknown, short *dir_diff)
+{
+	char *name;
+	size_t i, k, *o;
+	int rt;
+	mode_t m0, m1, m[2];
+
+	o = ino_order ? dnam_inoord(ln) : NULL;
+
+	for (k = 0; k < ln->num; k++) {
+		i = o ? o[k] : k;
+		name = ln->v[i];
+
+		if (pscan_cat(c->pth[0], c->len[0], name) == (size_t)-1) {
+			continue;
+		}
+
+		if (!(d->tree & 2) || (rknown && !ln->pr[i])) {
+			rt = -1;
+		} else {
+			rt = DNAM_PRTYP(ln->pr[i]);
+		}
+
+		if (dnam_notstat(DNAM_TYP(name), rt, followlinks, find_name,
+		    m)) {
+			m0 = m[0];
+			m1 = m[1];
+
+			if ((d->tree & 2) && pscan_cat(c->pth[1], c->len[1],
+			    name) == (size_t)-1) {
+				continue;
+			}
+
+			goto cmp;
+		}
+
+		if (pscan_stat(c, 0) == -1) {
+			if (errno != ENOENT) {
+				pscan_err("stat \"%s\": %s", c->pth[0],
+				    strerror(errno));
+				continue;
+			}
+
+			c->st[0].st_mode = 0;
+		}
+
+		c->st[1].st_mode = 0;
+
+		if ((d->tree & 2) && (!rknown || ln->pr[i])) {
+			if (pscan_cat(c->pth[1], c->len[1], name) ==
+			    (size_t)-1) {
+				continue;
+			}
+
+			if (pscan_stat(c, 1) == -1) {
+				if (errno != ENOENT) {
+					pscan_err("stat \"%s\" failed: %s",
+					    c->pth[1], strerror(errno));
+					continue;
+				}
+
+				c->st[1].st_mode = 0;
+			}
+		}
+
+		m0 = c->st[0].st_mode;
+		m1 = c->st[1].st_mode;
+cmp:
+		if (S_ISDIR(m0) && S_ISDIR(m1)) {
+			pscan_push(w, c, name, 3);
+			continue;
+		}
+
+		if (find_name) {
+			if (!fn_match(name)) {
+				*dir_diff = 1;
+			}
+
+			continue;
+		}
+
+		if (S_ISREG(m0) && S_ISREG(m1)) {
+			if (c->st[0].st_size != c->st[1].st_size) {
+				*dir_diff = 1;
+			} else if (!c->st[0].st_size || pscan_nocmp) {
+			} else {
+				switch (fcmp_data(&c->fc, c->pth[0],
+				    c->pth[1], c->buf[1], BUF_SIZE, NULL)) {
+				case -1:
+					pscan_err("%s", c->buf[1]);
+					break;
+				case 1:
+					*dir_diff = 1;
+				}
+			}
+
+			continue;
+		}
+
+		if (S_ISLNK(m0) && S_ISLNK(m1)) {
+			if (pscan_lnkcmp(c) == 1) {
+				*dir_diff = 1;
+			}
+
+			continue;
+		}
+
+		if (real_diff) {
+			continue;
+		}
+
+		if (!m0 || !m1 || m0 != m1) {
+			*dir_diff = 1;
+		}
+	}
+
+	free(o);
+}
+
+static void
+pscan_right(struct pscan_wrk *c, unsigned w, struct dnam *rn,
+    short *dir_diff)
+{
+	char *name;
+	size_t i, k, *o;
+	mode_t m[2];
+
+	o = ino_order ? dnam_inoord(rn) : NULL;
+
+	for (k = 0; k < rn->num; k++) {
+		i = o ? o[k] : k;
+		name = rn->v[i];
+
+		/* Processed in pscan_left() */
+		if (rn->pr[i]) {
+			continue;
+		}
+
+		if (!file_pattern) {
+			*dir_diff = 1;
+			break;
+		}
+
+		if (pscan_cat(c->pth[1], c->len[1], name) == (size_t)-1) {
+			continue;
+		}
+
+		if (dnam_notstat(DNAM_TYP(name), -1, followlinks, find_name,
+		    m)) {
+			c->st[1].st_mode = m[0];
+		} else if (pscan_stat(c, 1) == -1) {
+			if (errno != ENOENT) {
+				pscan_err("stat \"%s\" failed: %s", c->pth[1],
+				    strerror(errno));
+			}
+
+			c->st[1].st_mode = 0;
+		}
+
+		if (S_ISDIR(c->st[1].st_mode)) {
+			pscan_push(w, c, name, 2);
+			continue;
+		}
+
+		if (find_name && !fn_match(name)) {
+			*dir_diff = 1;
+		}
+	}
+
+	free(o);
+}
+
+static void
+pscan_push(unsigned w, struct pscan_wrk *c, const char *name, short tree)
+{
+	struct pscan_dir *d;
+
+	d = malloc(sizeof(struct pscan_dir));
+	d->tree = tree;
+
+	/* pscan_cat() had already been called for both paths */
+	c->pth[0][c->len[0]] = 0;
+	d->pth[0] = malloc(c->len[0] + strlen(name) + 2);
+	memcpy(d->pth[0], c->pth[0], c->len[0] + 1);
+	pscan_cat(d->pth[0], c->len[0], name);
+
+	if (tree & 2) {
+		c->pth[1][c->len[1]] = 0;
+		d->pth[1] = malloc(c->len[1] + strlen(name) + 2);
+		memcpy(d->pth[1], c->pth[1], c->len[1] + 1);
+		pscan_cat(d->pth[1], c->len[1], name);
+	} else {
+		d->pth[1] = strdup(c->pth[1]);
+	}
+
+	pool_add(pool, w, pscan_dir, d);
+}
+
+static int
+pscan_stat(struct pscan_wrk *c, int i)
+{
+	int r;
+
+	if (!followlinks ||
+	    (r = stx_stat(c->pth[i], &c->st[i], c->stm[i])) == -1) {
+		r = stx_lstat(c->pth[i], &c->st[i], c->stm[i]);
+	}
+
+	return r;
+}
+
+/* -1: Error, 0: Same link target, 1: Different targets */
+
+static int
+pscan_lnkcmp(struct pscan_wrk *c)
+{
+	ssize_t l[2];
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if ((l[i] = readlink(c->pth[i], c->buf[i], BUF_SIZE)) ==
+		    -1) {
+			pscan_err("readlink \"%s\" failed: %s", c->pth[i],
+			    strerror(errno));
+			return -1;
+		}
+	}
+
+	return l[0] != l[1] || memcmp(c->buf[0], c->buf[1], l[0]) ? 1 : 0;
+}
+
+/* Same as pthadd() in diff.c but without UI calls.
+ * (size_t)-1: Path buffer overflow */
+
+static size_t
+pscan_cat(char *p, size_t l, const char *n)
+{
+	size_t ln = strlen(n);
+
+	if (l + ln + 2 > PATHSIZ) {
+		pscan_err("Path buffer overflow");
+		return (size_t)-1;
+	}
+
+	if (ln && l && p[l-1] != '/')
+		p[l++] = '/';
+
+	memcpy(p + l, n, ln + 1);
+	return l + ln;
+}
+
+/* Report directory pth[i] as directory with differences */
+
+static void
+pscan_diff(struct pscan_wrk *c, int i)
+{
+	struct strlst *s;
+
+	c->pth[i][c->len[i]] = 0;
+	s = malloc(sizeof(struct strlst));
+	s->str = strdup(c->pth[i]);
+	pool_lock(pool);
+	s->next = pscan_res;
+	pscan_res = s;
+	pool_unlock(pool);
+}
+
+/* Frees a struct pscan_dir, also for tasks discarded by pool_free() */
+
+static void
+pscan_dfree(void *arg)
+{
+	struct pscan_dir *d = arg;
+
+	free(d->pth[0]);
+	free(d->pth[1]);
+	free(d);
+}
+
+/* The first error message is saved for a dialog after the scan. */
+
+static void
+pscan_err(const char *fmt, ...)
+{
+	va_list ap;
+	char *s;
+
+	s = malloc(PATHSIZ);
+	va_start(ap, fmt);
+	vsnprintf(s, PATHSIZ, fmt, ap);
+	va_end(ap);
+	pool_lock(pool);
+
+	if (!pscan_nerr++) {
+		pscan_msg = s;
+		s = NULL;
+	}
+
+	pool_unlock(pool);
+	free(s);
+}
+
+/* Main thread only */
+
+static void
+pscan_merge(void)
+{
+	struct strlst *s, *p;
+
+	if (pool) {
+		pool_lock(pool);
+	}
+
+	s = pscan_res;
+	pscan_res = NULL;
+
+	if (pool) {
+		pool_unlock(pool);
+	}
+
+	while (s) {
+		add_diff_pth(s->str);
+		free(s->str);
+		p = s;
+		s = s->next;
+		free(p);
+	}
+}
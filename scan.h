@@ -0,0 +1 @@
+int pscan(void);
@@ -0,0 +1,179 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* stat(2) and lstat(2) replacements which use statx(2) on Linux.  Only the
+ * fields in the mask are requested, which saves inode fetches on network
+ * file systems.  Fields which are not requested are 0.  Thread-safe. */
+
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_STATX
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/syscall.h>
+# include <sys/vfs.h>
+# include <linux/stat.h>
+# ifdef USE_SYS_SYSMACROS_H
+#  include <sys/sysmacros.h>
+# endif
+#endif
+#include "stx.h"
+
+#ifdef HAVE_STATX
+# ifndef AT_STATX_DONT_SYNC
+#  define AT_STATX_DONT_SYNC 0x4000
+# endif
+# define NFS_SUPER_MAGIC  0x6969
+# define FUSE_SUPER_MAGIC 0x65735546
+
+static int stx(const char *, struct stat *, unsigned, int);
+
+/* Set if the kernel does not support statx(2) */
+static volatile int nostatx;
+#endif
+
+/* Use AT_STATX_DONT_SYNC on NFS and FUSE (RC file option) */
+short stat_nosync;
+
+int
+stx_stat(const char *p, struct stat *s, unsigned m)
+{
+#ifdef HAVE_STATX
+	if (!nostatx) {
+		return stx(p, s, m, 0);
+	}
+#else
+	(void)m;
+#endif
+	return stat(p, s);
+}
+
+int
+stx_lstat(const char *p, struct stat *s, unsigned m)
+{
+#ifdef HAVE_STATX
+	if (!nostatx) {
+		return stx(p, s, m, AT_SYMLINK_NOFOLLOW);
+	}
+#else
+	(void)m;
+#endif
+	return lstat(p, s);
+}
+
+/* Returns STX_NOSYNC if option stat_nosync is set and directory {p} is
+ * on NFS or FUSE, else 0. */
+
+unsigned
+stx_dirfl(const char *p)
+{
+#ifdef HAVE_STATX
+	struct statfs fs;
+
+	if (!stat_nosync || statfs(p, &fs) == -1) {
+		return 0;
+	}
+
+	if (fs.f_type == NFS_SUPER_MAGIC || fs.f_type == FUSE_SUPER_MAGIC) {
+		return STX_NOSYNC;
+	}
+#else
+	(void)p;
+#endif
+	return 0;
+}
+
+#ifdef HAVE_STATX
+static int
+stx(const char *p, struct stat *s, unsigned m, int fl)
+{
+	struct statx x;
+	unsigned xm;
+
+	xm = stx_xmask(m, &fl);
+
+	if (syscall(SYS_statx, AT_FDCWD, p, fl, xm, &x) == -1) {
+		if (errno == ENOSYS) {
+			nostatx = 1;
+			return fl & AT_SYMLINK_NOFOLLOW ? lstat(p, s) :
+			    stat(p, s);
+		}
+
+		return -1;
+	}
+
+	stx_conv(&x, s);
+	return 0;
+}
+
+/* Converts a STX_* mask to a statx() mask. Adds flags to {*fl}. */
+
+unsigned
+stx_xmask(unsigned m, int *fl)
+{
+	unsigned xm = STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_INO;
+
+	if (m & STX_OWNER) {
+		xm |= STATX_UID | STATX_GID;
+	}
+
+	if (m & STX_MTIME) {
+		xm |= STATX_MTIME;
+	}
+
+	if (m & STX_ATIME) {
+		xm |= STATX_ATIME;
+	}
+
+	if (m & STX_NOSYNC) {
+		*fl |= AT_STATX_DONT_SYNC;
+	}
+
+	return xm;
+}
+
+void
+stx_conv(struct statx *x, struct stat *s)
+{
+	memset(s, 0, sizeof(struct stat));
+	s->st_mode = x->stx_mode;
+	s->st_size = x->stx_size;
+	s->st_ino = x->stx_ino;
+	s->st_nlink = x->stx_nlink;
+	s->st_dev = makedev(x->stx_dev_major, x->stx_dev_minor);
+	s->st_rdev = makedev(x->stx_rdev_major, x->stx_rdev_minor);
+
+	if (x->stx_mask & STATX_UID) {
+		s->st_uid = x->stx_uid;
+	}
+
+	if (x->stx_mask & STATX_GID) {
+		s->st_gid = x->stx_gid;
+	}
+
+	if (x->stx_mask & STATX_MTIME) {
+		s->st_mtim.tv_sec = x->stx_mtime.tv_sec;
+		s->st_mtim.tv_nsec = x->stx_mtime.tv_nsec;
+	}
+
+	if (x->stx_mask & STATX_ATIME) {
+		s->st_atim.tv_sec = x->stx_atime.tv_sec;
+		s->st_atim.tv_nsec = x->stx_atime.tv_nsec;
+	}
+}
+#endif
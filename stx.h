@@ -0,0 +1,19 @@
+/* Type, mode, size, inode and device are always requested */
+#define STX_OWNER  1 /* uid, gid */
+#define STX_MTIME  2
+#define STX_ATIME  4
+#define STX_ALL    (STX_OWNER | STX_MTIME | STX_ATIME)
+/* Don't sync attributes with the server (NFS, FUSE) */
+#define STX_NOSYNC 8
+
+extern short stat_nosync;
+
+int stx_stat(const char *, struct stat *, unsigned);
+int stx_lstat(const char *, struct stat *, unsigned);
+unsigned stx_dirfl(const char *);
+#ifdef HAVE_STATX
+struct statx;
+
+unsigned stx_xmask(unsigned, int *);
+void stx_conv(struct statx *, struct stat *);
+#endif
@@ -20,14 +20,13 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <pwd.h>
-#include <grp.h>
 #include <time.h>
 #include <ctype.h>
 #include <errno.h>
 #include <regex.h>
 #include <time.h>
 #include <signal.h>
+#include <stdint.h>
 #ifdef USE_SYS_SYSMACROS_H
 # include <sys/sysmacros.h>
 #endif
@@ -48,6 +47,11 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "dl.h"
 #include "cplt.h"
 #include "misc.h"
+#include "acmp.h"
+#include "dgst.h"
+#include "gqi.h"
+#include "lcache.h"
+#include "pfch.h"
 
 static void ui_ctrl(void);
 static void page_down(void);
@@ -206,11 +210,15 @@ do_diff:
 		build_diff_db(3);
 
 	if (qdiff) {
+		dgst_save();
+		gqi_save();
 		return;
 	}
 
 	disp_fmode();
 	ui_ctrl();
+	dgst_save();
+	gqi_save();
 
 	sig_term(0); /* remove tmp dirs */
 
@@ -269,10 +277,17 @@ next_key:
 		}
 
 		opt_flushinp();
+		/* Show results of background compares while waiting */
+		acmp_poll();
+		/* Read the directories near the cursor while waiting */
+		pf_near();
 
 		while ((c = getch()) == ERR) {
+			acmp_poll();
 		}
 
+		acmp_notmo();
+
 #if defined(TRACE)
 		if (isascii(c) && !iscntrl(c)) {
 			fprintf(debug, "<>getch: '%c'\n", c);
@@ -735,7 +750,7 @@ next_key:
 				}
 
 				sorting = DIRSFIRST;
-				rebuild_db(1);
+				re_sort_list();
 				break;
 
 			} else if (*key != 'd') {
@@ -762,7 +777,7 @@ next_key:
 				}
 
 				sorting = SORTMTIME;
-				rebuild_db(1);
+				re_sort_list();
 				goto next_key;
 
 			case 'A':
@@ -1122,7 +1137,7 @@ next_key:
 					break;
 
 				sorting = SORTMIXED;
-				rebuild_db(1);
+				re_sort_list();
 				break;
 			}
 
@@ -1177,7 +1192,7 @@ next_key:
 					break;
 
 				sorting = SORTSIZE;
-				rebuild_db(1);
+				re_sort_list();
 				break;
 			}
 
@@ -1527,7 +1542,8 @@ next_key:
 			c = 0;
 			dontcmp = dontcmp ? FALSE : TRUE;
 
-			if (!(bmode || fmode || dontcmp)) {
+			/* Also stops pending background compares */
+			if (!(bmode || fmode) && (!dontcmp || acmp_busy())) {
 				rebuild_db(0);
 			}
 
@@ -2345,6 +2361,67 @@ out:
 	return;
 }
 
+/* Keys which are processed while a list is still read (see option
+ * "incremental").  1: {c} has been processed, 0: The list has to be
+ * complete for {c}. */
+
+int
+ui_inc_key(int c)
+{
+	/* Set by ini_int() */
+	nodelay(stdscr, FALSE);
+
+	switch (c) {
+	case KEY_DOWN:
+	case 'j':
+	case '+':
+		curs_down();
+		break;
+	case KEY_UP:
+	case 'k':
+	case '-':
+		curs_up();
+		break;
+	case KEY_NPAGE:
+	case ' ':
+		page_down();
+		break;
+	case KEY_PPAGE:
+	case KEY_BACKSPACE:
+	case CERASE:
+		page_up();
+		break;
+	case CTRL('e'):
+		scroll_down(1, FALSE, -1);
+		break;
+	case CTRL('y'):
+		scroll_up(1, FALSE, -1);
+		break;
+	case KEY_HOME:
+		curs_first();
+		break;
+	case KEY_END:
+		curs_last();
+		break;
+	case '/':
+		ui_srch();
+		break;
+	case 'n':
+	case 'N':
+		if (regex_mode) {
+			regex_srch(c == 'n' ? 1 : -1);
+			break;
+		}
+
+		/* fall through */
+	default:
+		c = 0;
+	}
+
+	nodelay(stdscr, TRUE);
+	return c ? 1 : 0;
+}
+
 static void
 page_down(void)
 {
@@ -2709,7 +2786,8 @@ exit:
 void
 disp_curs(
     /* 0: Remove cursor
-     * 1: Normal cursor */
+     * 1: Normal cursor
+     * 2: Normal cursor, status line is not changed */
     int a)
 {
 	WINDOW *w;
@@ -2774,18 +2852,21 @@ disp_curs(
 void
 disp_list(
     /* Reserverd for 32 mode flags
-     * Value 0: No cursor! */
+     * Value 0: No cursor!
+     * Value 2: Status line is not changed */
     unsigned md)
 {
 	unsigned y, i;
 	WINDOW *w;
 	bool cg;
+	int info;
 
 #if defined(TRACE)
 	fprintf(debug, "->disp_list(%u) col=%d\n", md, right_col);
 #endif
 	w = getlstwin();
 	cg = CHGAT_MRKS;
+	info = md == 2 ? 2 : 1;
 
 	/* For the case that entries had been removed
 	 * and page_down() */
@@ -2825,14 +2906,14 @@ disp_list(
 			mvwaddch(w, y, llstw, ' ');
 			standendc(w);
 		} else if (md && y == curs[right_col]) {
-			disp_curs(1);
+			disp_curs(info);
 		} else if ((long)(top_idx[right_col] + y) ==
 		    mark_idx[right_col]) {
 			if (!cg) {
 				markc(w);
 			}
 
-			disp_line(y, i, 1);
+			disp_line(y, i, info);
 
 			if (cg) {
 				chgat_mark(w, y);
@@ -2843,7 +2924,7 @@ disp_list(
 				mmrkc(w);
 			}
 
-			disp_line(y, i, 1);
+			disp_line(y, i, info);
 
 			if (cg) {
 				chgat_mmrk(w, y);
@@ -2867,7 +2948,8 @@ disp_line(
     unsigned y,
     /* DB index */
     unsigned i,
-    /* 1: Is cursor line */
+    /* 1: Is cursor line
+     * 2: Is cursor line, status line is not changed */
     int info)
 {
 	int diff = 'E'; /* Internal error */
@@ -2949,8 +3031,8 @@ no_diff:
 #endif
 	disp_name(w, y, 0, twocols && !fmode ? llstw : mx, info, f, *type,
 	    color_id,
-	    right_col           ? f->rlink :
-	    twocols || f->llink ? f->llink : f->rlink,
+	    right_col              ? FD_RLINK(f) :
+	    twocols || FD_LLINK(f) ? FD_LLINK(f) : FD_RLINK(f),
 	    diff, fmode ? right_col : twocols || f->type[0] ? 0 : 1);
 
 	if (twocols && !fmode) {
@@ -2963,7 +3045,7 @@ prtc2:
 			    type[1], f->type[1], f->name);
 #endif
 			disp_name(w, y, rlstx, mx, info, f, type[1], color_id,
-			    f->rlink, diff, 1);
+			    FD_RLINK(f), diff, 1);
 		}
 
 		standoutc(w);
@@ -2971,7 +3053,7 @@ prtc2:
 		standendc(w);
 	}
 
-	if (!info) {
+	if (info != 1) {
 		goto ret;
 	}
 
@@ -3003,17 +3085,17 @@ prtc2:
 
 		mvwaddstr(wstat, 0, tc ? 0 : 2, type_name(f->type[0]));
 
-		if (f->llink) {
+		if (FD_LLINK(f)) {
 			addmbs(wstat, " -> ", mx);
-			addmbs(wstat, f->llink, mx);
+			addmbs(wstat, FD_LLINK(f), mx);
 		}
 
 		mvwaddstr(wstat, tc ? 0 : 1, tc ? rlstx : 2,
 		    type_name(f->type[1]));
 
-		if (f->rlink) {
+		if (FD_RLINK(f)) {
 			addmbs(wstat, " -> ", 0);
-			addmbs(wstat, f->rlink, 0);
+			addmbs(wstat, FD_RLINK(f), 0);
 		}
 	} else if (fmode) {
 		file_stat(
@@ -3079,12 +3161,15 @@ disp_name(WINDOW *w, int y, int x, int mx,
     int i) /* tree--*not* col! */
 {
 	int j;
-	struct passwd *pw;
-	struct group *gr;
+	const char *s;
 	int db;
 
 	db = fmode ? right_col : 0;
 
+	if (add_owner || add_group || add_mtime) {
+		diff_fill(f);
+	}
+
 	if (add_mode) {
 		mx -= 5;
 	}
@@ -3154,10 +3239,10 @@ disp_name(WINDOW *w, int y, int x, int mx,
 	}
 
 	if (add_owner) {
-		if ((pw = getpwuid(f->uid[i])))
-			memcpy(lbuf, pw->pw_name, strlen(pw->pw_name) + 1);
+		if ((s = usr_name(f->cold->uid[i])))
+			memcpy(lbuf, s, strlen(s) + 1);
 		else
-			snprintf(lbuf, sizeof lbuf, "%u", f->uid[i]);
+			snprintf(lbuf, sizeof lbuf, "%u", f->cold->uid[i]);
 
 		wmove(w, y, mx + 1);
 		addmbs(w, lbuf, 0);
@@ -3165,10 +3250,10 @@ disp_name(WINDOW *w, int y, int x, int mx,
 	}
 
 	if (add_group) {
-		if ((gr = getgrgid(f->gid[i])))
-			memcpy(lbuf, gr->gr_name, strlen(gr->gr_name) + 1);
+		if ((s = grp_name(f->cold->gid[i])))
+			memcpy(lbuf, s, strlen(s) + 1);
 		else
-			snprintf(lbuf, sizeof lbuf, "%u", f->gid[i]);
+			snprintf(lbuf, sizeof lbuf, "%u", f->cold->gid[i]);
 
 		wmove(w, y, mx + 1);
 		addmbs(w, lbuf, 0);
@@ -3191,8 +3276,8 @@ disp_name(WINDOW *w, int y, int x, int mx,
 		if (S_ISCHR(f->type[i]) || S_ISBLK(f->type[i])) {
 
 			n = snprintf(lbuf, sizeof lbuf, "%lu, %lu",
-			    (unsigned long)major(f->rdev[i]),
-			    (unsigned long)minor(f->rdev[i]));
+			    (unsigned long)major(FD_RDEV(f, i)),
+			    (unsigned long)minor(FD_RDEV(f, i)));
 		} else {
 			n = getfilesize(lbuf, sizeof lbuf, f->siz[i], 2);
 		}
@@ -3205,7 +3290,7 @@ disp_name(WINDOW *w, int y, int x, int mx,
 		size_t n;
 
 		mx += 13;
-		n = gettimestr(lbuf, sizeof lbuf, &f->mtim[i]);
+		n = gettimestr(lbuf, sizeof lbuf, &f->cold->mtim[i].tv_sec);
 		wmove(w, y, mx - n);
 		addmbs(w, lbuf, 0);
 	}
@@ -3250,8 +3335,7 @@ static void
 file_stat(struct filediff *f, struct filediff *f2)
 {
 	int x, x2, w, w1, w2, yl, yr, lx1, lx2, mx1;
-	struct passwd *pw;
-	struct group *gr;
+	const char *s;
 	mode_t ltyp, rtyp;
 	bool tc = twocols || mark;
 
@@ -3265,6 +3349,14 @@ file_stat(struct filediff *f, struct filediff *f2)
 	rtyp = f2 ? f2->type[1] : 0;
 	mx1 = tc ? llstw : 0;
 
+	if (f) {
+		diff_fill(f);
+	}
+
+	if (f2 && f2 != f) {
+		diff_fill(f2);
+	}
+
 	if (bmode) {
 		if (!mark || dir_change) {
 			wmove(wstat, 1, 0);
@@ -3283,14 +3375,14 @@ file_stat(struct filediff *f, struct filediff *f2)
 	if (S_ISLNK(ltyp)) {
 		wmove(wstat, yl, x);
 		addmbs(wstat, "-> ", mx1);
-		putmbsra(wstat, f->llink, mx1);
+		putmbsra(wstat, FD_LLINK(f), mx1);
 		ltyp = 0;
 	}
 
 	if (S_ISLNK(rtyp)) {
 		wmove(wstat, yr, x2);
 		addmbs(wstat, "-> ", 0);
-		putmbsra(wstat, f2->rlink, 0);
+		putmbsra(wstat, FD_RLINK(f2), 0);
 		rtyp = 0;
 	}
 
@@ -3310,17 +3402,17 @@ file_stat(struct filediff *f, struct filediff *f2)
 		rtyp = 0;
 
 	if (ltyp) {
-		if ((pw = getpwuid(f->uid[0])))
-			memcpy(lbuf, pw->pw_name, strlen(pw->pw_name) + 1);
+		if ((s = usr_name(f->cold->uid[0])))
+			memcpy(lbuf, s, strlen(s) + 1);
 		else
-			snprintf(lbuf, sizeof lbuf, "%u", f->uid[0]);
+			snprintf(lbuf, sizeof lbuf, "%u", f->cold->uid[0]);
 	}
 
 	if (rtyp) {
-		if ((pw = getpwuid(f2->uid[1])))
-			memcpy(rbuf, pw->pw_name, strlen(pw->pw_name) + 1);
+		if ((s = usr_name(f2->cold->uid[1])))
+			memcpy(rbuf, s, strlen(s) + 1);
 		else
-			snprintf(rbuf, sizeof rbuf, "%u", f2->uid[1]);
+			snprintf(rbuf, sizeof rbuf, "%u", f2->cold->uid[1]);
 	}
 
 	if (ltyp) {
@@ -3351,17 +3443,17 @@ file_stat(struct filediff *f, struct filediff *f2)
 		rtyp = 0;
 
 	if (ltyp) {
-		if ((gr = getgrgid(f->gid[0])))
-			memcpy(lbuf, gr->gr_name, strlen(gr->gr_name) + 1);
+		if ((s = grp_name(f->cold->gid[0])))
+			memcpy(lbuf, s, strlen(s) + 1);
 		else
-			snprintf(lbuf, sizeof lbuf, "%u", f->gid[0]);
+			snprintf(lbuf, sizeof lbuf, "%u", f->cold->gid[0]);
 	}
 
 	if (rtyp) {
-		if ((gr = getgrgid(f2->gid[1])))
-			memcpy(rbuf, gr->gr_name, strlen(gr->gr_name) + 1);
+		if ((s = grp_name(f2->cold->gid[1])))
+			memcpy(rbuf, s, strlen(s) + 1);
 		else
-			snprintf(rbuf, sizeof rbuf, "%u", f2->gid[1]);
+			snprintf(rbuf, sizeof rbuf, "%u", f2->cold->gid[1]);
 	}
 
 	if (ltyp) {
@@ -3396,8 +3488,8 @@ file_stat(struct filediff *f, struct filediff *f2)
 	if (ltyp && !S_ISDIR(ltyp)) {
 		if (S_ISCHR(ltyp) || S_ISBLK(ltyp))
 			w1 = snprintf(lbuf, sizeof lbuf, "%lu, %lu",
-			    (unsigned long)major(f->rdev[0]),
-			    (unsigned long)minor(f->rdev[0]));
+			    (unsigned long)major(FD_RDEV(f, 0)),
+			    (unsigned long)minor(FD_RDEV(f, 0)));
 		else
 			w1 = getfilesize(lbuf, sizeof lbuf, f->siz[0],
 			    scale || twocols ? 1 : 0);
@@ -3409,8 +3501,8 @@ file_stat(struct filediff *f, struct filediff *f2)
 	if (rtyp && !S_ISDIR(rtyp)) {
 		if (S_ISCHR(rtyp) || S_ISBLK(rtyp))
 			w2 = snprintf(rbuf, sizeof rbuf, "%lu, %lu",
-			    (unsigned long)major(f2->rdev[1]),
-			    (unsigned long)minor(f2->rdev[1]));
+			    (unsigned long)major(FD_RDEV(f2, 1)),
+			    (unsigned long)minor(FD_RDEV(f2, 1)));
 		else
 			w2 = getfilesize(rbuf, sizeof rbuf, f2->siz[1],
 			    scale || twocols ? 1 : 0);
@@ -3451,27 +3543,29 @@ file_stat(struct filediff *f, struct filediff *f2)
 		rtyp = 0;
 
 	if (ltyp) {
-		lx1 = x + gettimestr(lbuf, sizeof lbuf, &f->mtim[0]);
+		lx1 = x + gettimestr(lbuf, sizeof lbuf,
+		    &f->cold->mtim[0].tv_sec);
 		wmove(wstat, yl, x);
 		addmbs(wstat, lbuf, mx1);
 	}
 
 	if (rtyp) {
-		lx2 = x2 + gettimestr(rbuf, sizeof rbuf, &f2->mtim[1]);
+		lx2 = x2 + gettimestr(rbuf, sizeof rbuf,
+		    &f2->cold->mtim[1].tv_sec);
 		wmove(wstat, yr, x2);
 		addmbs(wstat, rbuf, 0);
 	}
 
-	if (ltyp && f->llink) {
+	if (ltyp && FD_LLINK(f)) {
 		wmove(wstat, yl, lx1);
 		addmbs(wstat, " -> ", mx1);
-		putmbsra(wstat, f->llink, mx1);
+		putmbsra(wstat, FD_LLINK(f), mx1);
 	}
 
-	if (rtyp && f2->rlink) {
+	if (rtyp && FD_RLINK(f2)) {
 		wmove(wstat, yr, lx2);
 		addmbs(wstat, " -> ", 0);
-		putmbsra(wstat, f2->rlink, 0);
+		putmbsra(wstat, FD_RLINK(f2), 0);
 	}
 }
 
@@ -3654,6 +3748,9 @@ mark_global(void)
 	mark_idx[right_col] = -1;
 	m = malloc(sizeof(struct filediff));
 	*m = *mark;
+	/* Is released with the list */
+	m->cold = NULL;
+	m->fl &= ~(FDFL_ARENA | FDFL_COL1);
 	mark = m;
 	mark_lnam = NULL;
 	mark_rnam = NULL;
@@ -3829,6 +3926,7 @@ push_state(char *name, char *rnam,
 
 
 	diff_db_store(st);
+	st->lck = lc_take();
 	st->llen = pthlen[0];
 	st->rlen = pthlen[1];
 
@@ -3909,6 +4007,9 @@ pop_state(
 		/* In diff mode a new scan DB is only required when
 		 * a compressed archive had been entered */
 		pop_scan_db();
+		/* The temporary directories are removed */
+		lc_flush();
+		pf_flush();
 	}
 
 	if (st->lzip) {
@@ -3948,6 +4049,10 @@ pop_state(
 			clr_mark();
 	}
 
+	if (mode == 1 && !st->lzip && !st->rzip) {
+		lc_save();
+	}
+
 	pthlen[0] = st->llen;
 	pthlen[1] = st->rlen;
 
@@ -3973,6 +4078,7 @@ pop_state(
 	ui_stack = st->next;
 	syspth[0][pthlen[0]] = 0; /* For 'p' (pwd) */
 	diff_db_restore(st);
+	lc_give(st->lck);
 	free(st);
 
 	if (!mode) {
@@ -4097,7 +4203,8 @@ enter_dir(char *name, char *rnam, bool lzip, bool rzip, short tree
 		push_state(name, rnam,
 		    (f2d ? 4 : 0) | (rzip ? 2 : 0) | (lzip ? 1 : 0));
 		subtree = (name ? 1 : 0) | (rnam ? 2 : 0);
-		scan_subdir(name, rnam, subtree);
+		scan_subdir(name, rnam, subtree |
+		    (f2d || lzip || rzip ? 0 : SCAN_LC));
 
 		if (f2d) {
 			free(name);
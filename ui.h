@@ -15,6 +15,8 @@
 #define CHGAT_MRKS (fmode || add_mode || add_hsize || add_bsize || add_mtime \
     || add_owner || add_group)
 
+struct lc_key;
+
 struct ui_state {
 	/* Path before going to temp dir for returning when leaving temp dir */
 	char *lpth, *rpth;
@@ -22,12 +24,16 @@ struct ui_state {
 	char *lzip, *rzip;
 	size_t llen, rlen;
 	void *bst;
+	struct arena *arena; /* memory of the entries in {bst} */
 	unsigned num; /* db_num */
+	unsigned tot; /* entries in {bst} */
+	int sortm; /* sort mode of {bst} (SORT_MODE()), -1: unsorted */
 	struct filediff **list;
 	unsigned top_idx, curs, mmrkd;
 	/* 1: Don't restore. Just remove tmpdir. */
 	unsigned fl;
 	unsigned short tree;
+	struct lc_key *lck; /* see lcache.c */
 	struct ui_state *next;
 };
 
@@ -36,6 +42,7 @@ void printerr(const char *, const char *, ...);
 int dialog(const char *, const char *, const char *, ...);
 int vdialog(const char *, const char *, const char *, va_list);
 void disp_list(unsigned);
+int ui_inc_key(int);
 void center(unsigned);
 void no_file(void);
 void action(short, unsigned);
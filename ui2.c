@@ -24,6 +24,7 @@ PERFORMANCE OF THIS SOFTWARE.
 #include <ctype.h>
 #include <stdarg.h>
 #include <signal.h>
+#include <stdint.h>
 #include "compat.h"
 #include "ed.h"
 #include "ui.h"
@@ -38,6 +39,11 @@ PERFORMANCE OF THIS SOFTWARE.
 #include "gq.h"
 #include "cplt.h"
 #include "misc.h"
+#include "pool.h"
+#include "dgst.h"
+#include "gqi.h"
+#include "lcache.h"
+#include "pfch.h"
 
 const char y_n_txt[] = "'y' yes, 'n' no";
 const char y_a_n_txt[] = "'y' yes, 'a' all, 'n' no, 'N' none, <ESC> cancel";
@@ -57,6 +63,7 @@ static char *getnextarg(char *, unsigned);
 static void set_all(void);
 static void sig_cont(int);
 static void long_shuffle(long *, const long);
+static void mark_reidx(void);
 
 long mark_idx[2] = { -1, -1 };
 long mmrkd[2];
@@ -652,6 +659,26 @@ cd_home:
 		return 0;
 	}
 
+	if (!strcmp(buf, "digest")) {
+		dgst_stat();
+		return 0;
+	}
+
+	if (!strcmp(buf, "grepindex")) {
+		gqi_stat();
+		return 0;
+	}
+
+	if (!strcmp(buf, "listcache")) {
+		lc_stat();
+		return 0;
+	}
+
+	if (!strcmp(buf, "mem")) {
+		diff_db_mem();
+		return 0;
+	}
+
 	if (!strcmp(buf, "marks")) {
 		list_jmrks();
 		return 0;
@@ -694,6 +721,9 @@ cd_home:
 		goto unkn_opt;
 	}
 
+	/* Cached listings may depend on the options */
+	lc_flush();
+	pf_flush();
 	need_arg = TRUE;
 next_opt:
 	if (!(buf = getnextarg(buf + skip, need_arg ? 1 : 0))) {
@@ -758,13 +788,49 @@ next_opt:
 	    (!strncmp(buf, "recursive ", (skip = 10)) &&
 	    (next_arg = TRUE))) {
 		recursive = not ? 0 : 1;
+		diff_db_filt_reset(0);
+		diff_db_filt_reset(1);
 
 	} else if (!strcmp(buf, "sortic") ||
 	         (!strncmp(buf, "sortic ", (skip = 7)) &&
 		 (next_arg = TRUE)))
 	{
 		sortic = not ? FALSE : TRUE ;
-		rebuild_db(1);
+		re_sort_list();
+
+	} else if (!not && !strncmp(buf, "threads=", 8)) {
+		char *e;
+		unsigned long n;
+
+		n = strtoul(buf + 8, &e, 10);
+
+		if (e == buf + 8 || (*e && *e != ' ')) {
+			printerr(NULL, "Number expected");
+		} else {
+			nworkers = n;
+
+			if (*e) {
+				skip = e - buf;
+				next_arg = TRUE;
+			}
+		}
+
+	} else if (!not && !strncmp(buf, "prefetch=", 9)) {
+		char *e;
+		unsigned long n;
+
+		n = strtoul(buf + 9, &e, 10);
+
+		if (e == buf + 9 || (*e && *e != ' ')) {
+			printerr(NULL, "Number expected");
+		} else {
+			pf_set(n);
+
+			if (*e) {
+				skip = e - buf;
+				next_arg = TRUE;
+			}
+		}
 
 	} else if (!strcmp(buf, "ws") ||
 	    (!strncmp(buf, "ws ", (skip = 3)) &&
@@ -823,6 +889,8 @@ set_all(void)
 	waddstr(wlist, magic ? nomagic_str + 2 : nomagic_str);
 	waddstr(wlist, rnd_mode ? norandom_str + 2 : norandom_str);
 	waddstr(wlist, recursive ? norecurs_str + 2 : norecurs_str);
+	wprintw(wlist, "threads=%u\n", pool_nworkers());
+	wprintw(wlist, "prefetch=%u\n", pf_max);
 	waddstr(wlist, nows ? nows_str : nows_str + 2);
 
 	if (anykey() == ':') {
@@ -957,6 +1025,13 @@ ret:
 #endif
 		break;
 	case 1:
+		if (cmp_off >= 0) {
+			printerr(any_txt,
+			    "Different at byte %lld: %s and %s",
+			    (long long)cmp_off, olnam, ornam);
+			break;
+		}
+
 		printerr(any_txt, "Different: %s and %s",
 #if defined(DEBUG) && 0
 		    lnam, rnam);
@@ -1075,6 +1150,7 @@ re_sort_list(void)
 
 	name = saveselname();
 	diff_db_sort(right_col);
+	mark_reidx();
 
 	if (name) {
 		center(findlistname(name));
@@ -1088,6 +1164,28 @@ re_sort_list(void)
 	nodelay(stdscr, FALSE);
 }
 
+/* Index of the marked entry after the list order had changed */
+
+static void
+mark_reidx(void)
+{
+	unsigned u;
+
+	if (!mark || gl_mark || mark_idx[right_col] < 0) {
+		return;
+	}
+
+	for (u = 0; u < db_num[right_col]; u++) {
+		if (db_list[right_col][u] == mark) {
+			mark_idx[right_col] = u;
+			return;
+		}
+	}
+
+	/* Filtered out */
+	mark_global();
+}
+
 /* 1: Cursor moved down */
 
 int
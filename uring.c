@@ -0,0 +1,431 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Optional io_uring(7) backend.  Many statx(2) calls of a directory are
+ * submitted together with one system call.  For a file compare both files
+ * are opened and read in parallel.  The ring is used by the main thread
+ * only.  It is set up with the raw system calls on the first use.  If the
+ * kernel does not support io_uring or one of the used operations,
+ * {use_uring} is reset and the callers use the synchronous functions. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_IO_URING
+# include <stdint.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+# include <linux/stat.h>
+#endif
+#include "fcmp.h"
+#include "uring.h"
+#include "stx.h"
+
+#ifdef HAVE_IO_URING
+/* Ring size.  Longer request vectors are submitted in chunks. */
+# define UR_ENT 128
+/* Read size of ur_cmp() */
+# define UR_BUFSIZ (256 * 1024)
+
+struct ur_ring {
+	int fd;
+	unsigned ent;
+	unsigned *sq_tail, *sq_mask, *sq_arr;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	/* Number of prepared but not submitted entries */
+	unsigned prep;
+};
+
+static int ur_start(void);
+static int ur_init(void);
+static struct io_uring_sqe *ur_sqe(int);
+static int ur_run(int *);
+
+static struct ur_ring ur;
+/* 0: Not initialized, 1: OK, -1: Not usable */
+static int ur_stat;
+static struct statx ur_x[UR_ENT];
+#endif
+
+/* Use io_uring (option -U) */
+short use_uring;
+
+/* Gets the attributes of all {n} paths in {v} (entries with pth == NULL
+ * are skipped).  Errors are returned per entry in {v}.
+ * 0: OK, -1: io_uring not usable, use stat(2) instead */
+
+int
+ur_statv(struct ur_stat *v, size_t n)
+{
+#ifdef HAVE_IO_URING
+	int res[UR_ENT];
+	size_t i, j, k;
+	unsigned c;
+
+	if (!use_uring || ur_start()) {
+		return -1;
+	}
+
+	for (i = 0; i < n; i = j) {
+		for (c = 0, j = i; j < n && c < ur.ent; j++) {
+			struct io_uring_sqe *e;
+			int fl;
+
+			if (!v[j].pth) {
+				continue;
+			}
+
+			e = ur_sqe(c);
+			fl = v[j].nofollow ? AT_SYMLINK_NOFOLLOW : 0;
+			e->opcode = IORING_OP_STATX;
+			e->fd = AT_FDCWD;
+			e->addr = (uintptr_t)v[j].pth;
+			e->len = stx_xmask(v[j].msk, &fl);
+			e->statx_flags = fl;
+			e->off = (uintptr_t)&ur_x[c];
+			c++;
+		}
+
+		if (!c) {
+			break;
+		}
+
+		if (ur_run(res)) {
+			return -1;
+		}
+
+		for (c = 0, k = i; k < j; k++) {
+			if (!v[k].pth) {
+				continue;
+			}
+
+			if (res[c] < 0) {
+				v[k].err = -res[c];
+			} else {
+				v[k].err = 0;
+				stx_conv(&ur_x[c], &v[k].st);
+			}
+
+			c++;
+		}
+	}
+
+	return 0;
+#else
+	(void)v;
+	(void)n;
+	return -1;
+#endif
+}
+
+/* Same as cmp_data(), but both files are opened and read in parallel.
+ * -2: io_uring not usable, use cmp_data() instead */
+
+int
+ur_cmp(struct fcmp *c, const char *lpth, const char *rpth, char *ebuf,
+    size_t esiz)
+{
+#ifdef HAVE_IO_URING
+	struct io_uring_sqe *e;
+	int res[2], f1, f2, rv = 0;
+	uint64_t off = 0;
+	char *buf1, *buf2;
+	size_t i;
+
+	if (!use_uring || ur_start() ||
+	    !(buf1 = fcmp_buf(c, UR_BUFSIZ, 2))) {
+		return -2;
+	}
+
+	buf2 = buf1 + c->siz;
+	c->off = 0;
+
+	e = ur_sqe(0);
+	e->opcode = IORING_OP_OPENAT;
+	e->fd = AT_FDCWD;
+	e->addr = (uintptr_t)lpth;
+	e->open_flags = O_RDONLY;
+	e = ur_sqe(1);
+	e->opcode = IORING_OP_OPENAT;
+	e->fd = AT_FDCWD;
+	e->addr = (uintptr_t)rpth;
+	e->open_flags = O_RDONLY;
+
+	if (ur_run(res)) {
+		return -2;
+	}
+
+	f1 = res[0];
+	f2 = res[1];
+
+	if (f1 < 0) {
+		snprintf(ebuf, esiz, "open \"%s\": %s", lpth,
+		    strerror(-f1));
+		rv = -1;
+		goto close_f2;
+	}
+
+	if (f2 < 0) {
+		snprintf(ebuf, esiz, "open \"%s\": %s", rpth,
+		    strerror(-f2));
+		rv = -1;
+		goto close_f1;
+	}
+
+# ifdef HAVE_POSIX_FADVISE
+	posix_fadvise(f1, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(f2, 0, 0, POSIX_FADV_SEQUENTIAL);
+# endif
+
+	while (1) {
+		e = ur_sqe(0);
+		e->opcode = IORING_OP_READ;
+		e->fd = f1;
+		e->addr = (uintptr_t)buf1;
+		e->len = UR_BUFSIZ;
+		e->off = off;
+		e = ur_sqe(1);
+		e->opcode = IORING_OP_READ;
+		e->fd = f2;
+		e->addr = (uintptr_t)buf2;
+		e->len = UR_BUFSIZ;
+		e->off = off;
+
+		if (ur_run(res)) {
+			rv = -2;
+			break;
+		}
+
+		if (res[0] < 0) {
+			snprintf(ebuf, esiz, "read \"%s\": %s", lpth,
+			    strerror(-res[0]));
+			rv = -1;
+			break;
+		}
+
+		if (res[1] < 0) {
+			snprintf(ebuf, esiz, "read \"%s\": %s", rpth,
+			    strerror(-res[1]));
+			rv = -1;
+			break;
+		}
+
+		i = fcmp_mem(buf1, buf2, res[0] < res[1] ? res[0] : res[1]);
+
+		if (res[0] != res[1] || i < (size_t)res[0]) {
+			c->off = off + i;
+			rv = 1;
+			break;
+		}
+
+		if (res[0] < UR_BUFSIZ) {
+			break;
+		}
+
+		off += res[0];
+	}
+
+close_f1:
+	if (f1 >= 0) {
+		close(f1);
+	}
+close_f2:
+	if (f2 >= 0) {
+		close(f2);
+	}
+
+	return rv;
+#else
+	(void)c;
+	(void)lpth;
+	(void)rpth;
+	(void)ebuf;
+	(void)esiz;
+	return -2;
+#endif
+}
+
+#ifdef HAVE_IO_URING
+/* 0: Ring is usable, else -1 and {use_uring} is reset */
+
+static int
+ur_start(void)
+{
+	if (!ur_stat) {
+		ur_stat = ur_init() ? -1 : 1;
+	}
+
+	if (ur_stat < 0) {
+		use_uring = 0;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+ur_init(void)
+{
+	struct io_uring_params p;
+	struct io_uring_probe *pr;
+	size_t sqsiz, cqsiz, prsiz;
+	char *sq, *cq;
+	int r;
+
+	memset(&p, 0, sizeof p);
+
+	if ((ur.fd = syscall(__NR_io_uring_setup, UR_ENT, &p)) == -1) {
+		return -1;
+	}
+
+	/* IORING_OP_STATX, _OPENAT and _READ are not supported by all
+	 * kernels with io_uring */
+	prsiz = sizeof(struct io_uring_probe) +
+	    256 * sizeof(struct io_uring_probe_op);
+	pr = calloc(1, prsiz);
+	r = syscall(__NR_io_uring_register, ur.fd, IORING_REGISTER_PROBE,
+	    pr, 256);
+
+	if (r == -1 || pr->last_op < IORING_OP_READ ||
+	    !(pr->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) ||
+	    !(pr->ops[IORING_OP_OPENAT].flags & IO_URING_OP_SUPPORTED) ||
+	    !(pr->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED)) {
+		free(pr);
+		goto close_fd;
+	}
+
+	free(pr);
+	sqsiz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqsiz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cqsiz > sqsiz) {
+			sqsiz = cqsiz;
+		}
+	}
+
+	if ((sq = mmap(NULL, sqsiz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_SQ_RING)) ==
+	    MAP_FAILED) {
+		goto close_fd;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else if ((cq = mmap(NULL, cqsiz, PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_POPULATE, ur.fd, IORING_OFF_CQ_RING)) ==
+	    MAP_FAILED) {
+		goto unmap_sq;
+	}
+
+	if ((ur.sqe = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ur.fd,
+	    IORING_OFF_SQES)) == MAP_FAILED) {
+		if (cq != sq) {
+			munmap(cq, cqsiz);
+		}
+
+		goto unmap_sq;
+	}
+
+	ur.sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	ur.sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	ur.sq_arr  = (unsigned *)(sq + p.sq_off.array);
+	ur.cq_head = (unsigned *)(cq + p.cq_off.head);
+	ur.cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	ur.cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	ur.cqe = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	ur.ent = p.sq_entries < UR_ENT ? p.sq_entries : UR_ENT;
+	return 0;
+
+unmap_sq:
+	munmap(sq, sqsiz);
+close_fd:
+	close(ur.fd);
+	return -1;
+}
+
+/* Returns the next free submission queue entry.  {id} is the index of the
+ * result in ur_run(). */
+
+static struct io_uring_sqe *
+ur_sqe(int id)
+{
+	unsigned i;
+	struct io_uring_sqe *e;
+
+	i = (*ur.sq_tail + ur.prep++) & *ur.sq_mask;
+	e = &ur.sqe[i];
+	memset(e, 0, sizeof(struct io_uring_sqe));
+	e->user_data = id;
+	ur.sq_arr[i] = i;
+	return e;
+}
+
+/* Submits all prepared entries and waits for their completion.  The
+ * results are stored in {res} by the IDs given to ur_sqe().
+ * 0: OK, -1: io_uring failed, {use_uring} is reset */
+
+static int
+ur_run(int *res)
+{
+	unsigned n, sub, done = 0, h;
+	int r;
+
+	n = sub = ur.prep;
+	ur.prep = 0;
+	__atomic_store_n(ur.sq_tail, *ur.sq_tail + n, __ATOMIC_RELEASE);
+
+	while (done < n) {
+		if ((r = syscall(__NR_io_uring_enter, ur.fd, sub, n - done,
+		    IORING_ENTER_GETEVENTS, NULL, 0)) == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			/* The ring is kept since entries may still be in
+			 * use by the kernel */
+			ur_stat = -1;
+			use_uring = 0;
+			return -1;
+		}
+
+		/* {r} is the number of submitted entries */
+		sub -= (unsigned)r < sub ? (unsigned)r : sub;
+		h = *ur.cq_head;
+
+		while (h != __atomic_load_n(ur.cq_tail, __ATOMIC_ACQUIRE)) {
+			struct io_uring_cqe *c = &ur.cqe[h & *ur.cq_mask];
+
+			res[c->user_data] = c->res;
+			h++;
+			done++;
+		}
+
+		__atomic_store_n(ur.cq_head, h, __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+#endif
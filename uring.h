@@ -0,0 +1,15 @@
+/* A stat request for ur_statv() */
+struct ur_stat {
+	const char *pth; /* NULL: Unused entry */
+	unsigned msk; /* STX_* mask */
+	int nofollow; /* lstat(2) instead of stat(2) */
+	int err; /* Output: errno, 0 on success */
+	struct stat st; /* Output */
+};
+
+struct fcmp;
+
+extern short use_uring;
+
+int ur_statv(struct ur_stat *, size_t);
+int ur_cmp(struct fcmp *, const char *, const char *, char *, size_t);
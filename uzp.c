@@ -254,6 +254,16 @@ rmtmpdirs(char *s, tool_flags_t tf)
 #endif
 }
 
+/* Returns the archive type of file name {name}.  Not thread-safe. */
+
+enum uz_id
+uz_type(char *name)
+{
+	int i;
+
+	return check_ext(name, &i);
+}
+
 struct filediff *
 unpack(const struct filediff *f, int tree, char **tmp,
     /* 1: Also unpack files, not just archives */
@@ -19,6 +19,7 @@ void rmtmpdirs(char *, tool_flags_t);
 int uz_init(void);
 void uz_add(char *, char *);
 void uz_exit(void);
+enum uz_id uz_type(char *);
 const char *gettmpdirbase(void);
 void setvpth(int);
 void setpthofs(int, char *, char *);
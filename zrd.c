@@ -0,0 +1,424 @@
+/*
+Copyright (c) 2018, Carsten Kunze <carsten.kunze@arcor.de>
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted, provided that the above
+copyright notice and this permission notice appear in all copies.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/* Stream decompression for the content search (configuration option
+ * grep_unpack).  Files with a compressed type of check_ext() are
+ * decompressed with zlib, libbzip2 or liblzma while they are read, no
+ * temporary files are used.  The type is confirmed by the magic number,
+ * other files are passed through unchanged.  Concatenated streams are
+ * read one after the other like zcat(1) does.  At most {max} bytes are
+ * returned for a compressed file. */
+
+#define ZRD_BUFSIZ (128 * 1024)
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <regex.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBZ
+# include <zlib.h>
+#endif
+#ifdef HAVE_LIBBZ2
+# include <bzlib.h>
+#endif
+#ifdef HAVE_LIBLZMA
+# include <lzma.h>
+#endif
+#include "compat.h"
+#include "main.h"
+#include "exec.h"
+#include "uzp.h"
+#include "zrd.h"
+
+enum zrd_typ { ZRD_RAW, ZRD_GZ, ZRD_BZ2, ZRD_XZ };
+
+struct zrd {
+	int fd;
+	enum zrd_typ typ;
+	unsigned char *ib; /* input buffer */
+	size_t ip, il; /* position and end of the input in {ib} */
+	off_t out, max; /* decompressed bytes, limit */
+	const char *msg; /* error message, NULL: errno */
+	bool chk; /* magic number not checked yet */
+	bool init; /* decoder is initialized */
+	bool mid; /* inside a stream */
+	bool ieof;
+	bool end;
+#ifdef HAVE_LIBZ
+	z_stream z;
+#endif
+#ifdef HAVE_LIBBZ2
+	bz_stream bz;
+#endif
+#ifdef HAVE_LIBLZMA
+	lzma_stream xz;
+#endif
+};
+
+static int zrd_fill(struct zrd *);
+static void zrd_magic(struct zrd *);
+static ssize_t zrd_dec(struct zrd *, unsigned char *, size_t);
+
+struct zrd *
+zrd_new(void)
+{
+	struct zrd *r;
+
+	r = calloc(1, sizeof(struct zrd));
+	r->ib = malloc(ZRD_BUFSIZ);
+	return r;
+}
+
+/* Returns 1 if files of type {id} can be decompressed */
+
+int
+zrd_can(enum uz_id id)
+{
+	switch (id) {
+#ifdef HAVE_LIBZ
+	case UZ_GZ:
+	case UZ_TGZ:
+		return 1;
+#endif
+#ifdef HAVE_LIBBZ2
+	case UZ_BZ2:
+	case UZ_TBZ:
+		return 1;
+#endif
+#ifdef HAVE_LIBLZMA
+	case UZ_XZ:
+	case UZ_TXZ:
+		return 1;
+#endif
+	default:
+		return 0;
+	}
+}
+
+/* Starts reading file {fd} of type {id}.  {max}: Limit of the
+ * decompressed bytes. */
+
+void
+zrd_open(struct zrd *r, int fd, enum uz_id id, off_t max)
+{
+	r->fd = fd;
+	r->typ = id == UZ_GZ || id == UZ_TGZ ? ZRD_GZ :
+	         id == UZ_BZ2 || id == UZ_TBZ ? ZRD_BZ2 :
+	         id == UZ_XZ || id == UZ_TXZ ? ZRD_XZ : ZRD_RAW;
+	r->ip = r->il = 0;
+	r->out = 0;
+	r->max = max;
+	r->msg = NULL;
+	r->chk = TRUE;
+	r->mid = FALSE;
+	r->ieof = FALSE;
+	r->end = FALSE;
+}
+
+/* Like read(2), but less than {n} bytes are only returned at the end.
+ * -1: Error, see zrd_err(). */
+
+ssize_t
+zrd_read(struct zrd *r, void *buf, size_t n)
+{
+	unsigned char *o = buf;
+	size_t l = 0, m;
+	ssize_t k;
+
+	if (r->chk) {
+		if (zrd_fill(r) == -1) {
+			return -1;
+		}
+
+		r->chk = FALSE;
+		zrd_magic(r);
+	}
+
+	while (l < n && !r->end) {
+		if (r->ip == r->il && !r->ieof && zrd_fill(r) == -1) {
+			return -1;
+		}
+
+		if (r->typ == ZRD_RAW) {
+			if (!(m = r->il - r->ip)) {
+				r->end = TRUE;
+				break;
+			}
+
+			if (m > n - l) {
+				m = n - l;
+			}
+
+			memcpy(o + l, r->ib + r->ip, m);
+			r->ip += m;
+			l += m;
+			continue;
+		}
+
+		m = n - l;
+
+		if ((off_t)m > r->max - r->out) {
+			m = r->max - r->out;
+		}
+
+		if (!m) {
+			r->end = TRUE; /* rest is not searched */
+			break;
+		}
+
+		if ((k = zrd_dec(r, o + l, m)) == -1) {
+			return -1;
+		}
+
+		r->out += k;
+		l += k;
+	}
+
+	return l;
+}
+
+const char *
+zrd_err(struct zrd *r)
+{
+	return r->msg;
+}
+
+void
+zrd_close(struct zrd *r)
+{
+	if (!r->init) {
+		return;
+	}
+
+	r->init = FALSE;
+
+	switch (r->typ) {
+#ifdef HAVE_LIBZ
+	case ZRD_GZ:
+		inflateEnd(&r->z);
+		break;
+#endif
+#ifdef HAVE_LIBBZ2
+	case ZRD_BZ2:
+		BZ2_bzDecompressEnd(&r->bz);
+		break;
+#endif
+#ifdef HAVE_LIBLZMA
+	case ZRD_XZ:
+		lzma_end(&r->xz);
+		break;
+#endif
+	default:
+		;
+	}
+}
+
+static int
+zrd_fill(struct zrd *r)
+{
+	ssize_t n;
+
+	if ((n = read(r->fd, r->ib, ZRD_BUFSIZ)) == -1) {
+		return -1;
+	}
+
+	r->ip = 0;
+	r->il = n;
+
+	if (!n) {
+		r->ieof = TRUE;
+	}
+
+	return 0;
+}
+
+/* Checks the magic number and initializes the decoder */
+
+static void
+zrd_magic(struct zrd *r)
+{
+	static const unsigned char gz[] = { 0x1f, 0x8b },
+	    bz[] = { 'B', 'Z', 'h' },
+	    xz[] = { 0xfd, '7', 'z', 'X', 'Z', 0 };
+	const unsigned char *s;
+	size_t l;
+
+	switch (r->typ) {
+	case ZRD_GZ:
+		s = gz;
+		l = sizeof gz;
+		break;
+	case ZRD_BZ2:
+		s = bz;
+		l = sizeof bz;
+		break;
+	case ZRD_XZ:
+		s = xz;
+		l = sizeof xz;
+		break;
+	default:
+		return;
+	}
+
+	if (r->il < l || memcmp(r->ib, s, l)) {
+		/* e.g. .Z files which zlib cannot read */
+		r->typ = ZRD_RAW;
+		return;
+	}
+
+	switch (r->typ) {
+#ifdef HAVE_LIBZ
+	case ZRD_GZ:
+		memset(&r->z, 0, sizeof r->z);
+		r->init = inflateInit2(&r->z, 15 + 16) == Z_OK;
+		break;
+#endif
+#ifdef HAVE_LIBBZ2
+	case ZRD_BZ2:
+		memset(&r->bz, 0, sizeof r->bz);
+		r->init = BZ2_bzDecompressInit(&r->bz, 0, 0) == BZ_OK;
+		break;
+#endif
+#ifdef HAVE_LIBLZMA
+	case ZRD_XZ:
+		memset(&r->xz, 0, sizeof r->xz);
+		r->init = lzma_stream_decoder(&r->xz, UINT64_MAX,
+		    LZMA_CONCATENATED) == LZMA_OK;
+		break;
+#endif
+	default:
+		;
+	}
+
+	if (!r->init) {
+		r->typ = ZRD_RAW;
+	}
+}
+
+/* Decompresses at most {n} bytes of the input in {r->ib} to {o}.  Returns
+ * the number of bytes, -1 on error. */
+
+static ssize_t
+zrd_dec(struct zrd *r, unsigned char *o, size_t n)
+{
+	size_t a = r->il - r->ip;
+	ssize_t k = 0;
+	int e;
+
+	/* End of input between two gzip or bzip2 streams.  liblzma handles
+	 * this itself. */
+	if (!a && r->ieof && r->typ != ZRD_XZ) {
+		if (r->mid) {
+			r->msg = "Unexpected end of file";
+			return -1;
+		}
+
+		r->end = TRUE;
+		return 0;
+	}
+
+	switch (r->typ) {
+#ifdef HAVE_LIBZ
+	case ZRD_GZ:
+		r->z.next_in = r->ib + r->ip;
+		r->z.avail_in = a;
+		r->z.next_out = o;
+		r->z.avail_out = n;
+		e = inflate(&r->z, Z_NO_FLUSH);
+		r->ip = r->il - r->z.avail_in;
+		k = n - r->z.avail_out;
+
+		if (e == Z_STREAM_END) {
+			inflateReset(&r->z);
+			r->mid = FALSE;
+		} else if (e == Z_OK || e == Z_BUF_ERROR) {
+			r->mid = TRUE;
+		} else if (!r->mid) {
+			/* Trailing garbage is ignored like by gzip(1) */
+			r->end = TRUE;
+		} else {
+			r->msg = r->z.msg ? r->z.msg : "Data error";
+			return -1;
+		}
+
+		break;
+#endif
+#ifdef HAVE_LIBBZ2
+	case ZRD_BZ2:
+		r->bz.next_in = (char *)r->ib + r->ip;
+		r->bz.avail_in = a;
+		r->bz.next_out = (char *)o;
+		r->bz.avail_out = n;
+		e = BZ2_bzDecompress(&r->bz);
+		r->ip = r->il - r->bz.avail_in;
+		k = n - r->bz.avail_out;
+
+		if (e == BZ_STREAM_END) {
+			BZ2_bzDecompressEnd(&r->bz);
+			memset(&r->bz, 0, sizeof r->bz);
+
+			if (BZ2_bzDecompressInit(&r->bz, 0, 0) != BZ_OK) {
+				r->init = FALSE;
+				r->msg = "Out of memory";
+				return -1;
+			}
+
+			r->mid = FALSE;
+		} else if (e == BZ_OK) {
+			r->mid = TRUE;
+		} else if (!r->mid) {
+			r->end = TRUE;
+		} else {
+			r->msg = "Data error";
+			return -1;
+		}
+
+		break;
+#endif
+#ifdef HAVE_LIBLZMA
+	case ZRD_XZ:
+		r->xz.next_in = r->ib + r->ip;
+		r->xz.avail_in = a;
+		r->xz.next_out = o;
+		r->xz.avail_out = n;
+		e = lzma_code(&r->xz, r->ieof ? LZMA_FINISH : LZMA_RUN);
+		r->ip = r->il - r->xz.avail_in;
+		k = n - r->xz.avail_out;
+
+		if (e == LZMA_STREAM_END) {
+			r->end = TRUE;
+		} else if (e != LZMA_OK) {
+			r->msg = e == LZMA_MEM_ERROR ? "Out of memory" :
+			    e == LZMA_BUF_ERROR ? "Unexpected end of file" :
+			    "Data error";
+			return -1;
+		}
+
+		break;
+#endif
+	default:
+		(void)o;
+		(void)n;
+		(void)e;
+		r->end = TRUE;
+	}
+
+	return k;
+}
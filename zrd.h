@@ -0,0 +1,8 @@
+struct zrd;
+
+struct zrd *zrd_new(void);
+int zrd_can(enum uz_id);
+void zrd_open(struct zrd *, int, enum uz_id, off_t);
+ssize_t zrd_read(struct zrd *, void *, size_t);
+const char *zrd_err(struct zrd *);
+void zrd_close(struct zrd *);